@@ -0,0 +1,640 @@
+// Benchmark harness: builds a synthetic library and drives Library through
+// scripted workloads with no console input, then prints the results as
+// JSON. Build with `make bench`; see docs/USAGE.md (Benchmarks).
+//
+//   library_bench [--scale N] [--books N] [--users N] [--history N] [--ops N]
+//                 [--seed S] [--db FILE] [--reuse] [--lazy-cache-mb MB]
+//                 [--group-commit] [--write-behind] [--oplog] [--max-loans N]
+//                 [--workloads a,b,...] [--out FILE]
+
+#define LIBRARY_NO_MAIN
+#include "../src/lib_management_sys_sqlite3.cpp"
+#include "synthetic_library.h"
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+// ----------------------
+// One workload's figures. Latency percentiles are only filled in for
+// workloads timed per operation.
+// ----------------------
+struct BenchResult {
+    string name;
+    size_t ops = 0;        // operations or rows processed
+    size_t ok = 0;         // operations that succeeded
+    double seconds = 0;
+    bool timed_ops = false;
+    LatencyHistogram::Snapshot latency;
+};
+
+struct BenchOptions {
+    SyntheticLibrary::Options data;
+    size_t ops = 10000;
+    string db_file = "bench.db";
+    bool reuse = false;
+    size_t cache_mb = 0;          // >0: lazy catalog
+    bool group_commit = false;
+    bool write_behind = false;
+    bool oplog = false;           // log operations to <db>.oplog
+    size_t max_loans = 1;         // loans per borrower in the checkout workload
+    string workloads = "load,checkout,return,scan,columnar,circulation,incremental,save";
+    string out_file;
+};
+
+static const vector<string> ALL_WORKLOADS = {"load", "checkout", "return", "scan", "columnar", "circulation", "incremental", "save", "recovery", "drift"};
+
+static bool wants(const BenchOptions& o, const string& w) {
+    return ("," + o.workloads + ",").find("," + w + ",") != string::npos;
+}
+
+static double since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t since_ns(chrono::steady_clock::time_point start) {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// Books plus users in the database, i.e. the rows a resident load reads
+static size_t count_rows(const string& path) {
+    sqlite3* db = nullptr;
+    size_t n = 0;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK) {
+        n = Library::count_rows(db, "SELECT (SELECT COUNT(*) FROM books) + (SELECT COUNT(*) FROM users);");
+    }
+    sqlite3_close(db);
+    return n;
+}
+
+static bool parse_bench_args(int argc, char** argv, BenchOptions& o) {
+    bool ops_set = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scale" && hasValue) {
+            size_t n = (size_t)max(1LL, atoll(argv[++i]));
+            o.data.books = o.data.users = n;
+            o.data.history = 2 * n;
+        } else if (arg == "--books" && hasValue) {
+            o.data.books = (size_t)max(1LL, atoll(argv[++i]));
+        } else if (arg == "--users" && hasValue) {
+            o.data.users = (size_t)max(1LL, atoll(argv[++i]));
+        } else if (arg == "--history" && hasValue) {
+            o.data.history = (size_t)max(0LL, atoll(argv[++i]));
+        } else if (arg == "--ops" && hasValue) {
+            o.ops = (size_t)max(1LL, atoll(argv[++i]));
+            ops_set = true;
+        } else if (arg == "--seed" && hasValue) {
+            o.data.seed = (uint64_t)atoll(argv[++i]);
+        } else if (arg == "--db" && hasValue) {
+            o.db_file = argv[++i];
+        } else if (arg == "--reuse") {
+            o.reuse = true;
+        } else if (arg == "--lazy-cache-mb" && hasValue) {
+            o.cache_mb = (size_t)max(1, atoi(argv[++i]));
+        } else if (arg == "--group-commit") {
+            o.group_commit = true;
+        } else if (arg == "--write-behind") {
+            o.write_behind = true;
+        } else if (arg == "--oplog") {
+            o.oplog = true;
+        } else if (arg == "--max-loans" && hasValue) {
+            o.max_loans = (size_t)max(1, atoi(argv[++i]));
+        } else if (arg == "--workloads" && hasValue) {
+            o.workloads = argv[++i];
+            stringstream ss(o.workloads);
+            string w;
+            while (getline(ss, w, ',')) {
+                if (find(ALL_WORKLOADS.begin(), ALL_WORKLOADS.end(), w) == ALL_WORKLOADS.end()) {
+                    cerr << "Unknown workload: " << w << " (choose from load,checkout,return,scan,columnar,circulation,incremental,save,recovery,drift)\n";
+                    return false;
+                }
+            }
+        } else if (arg == "--out" && hasValue) {
+            o.out_file = argv[++i];
+        } else {
+            cerr << "Unknown option: " << arg << "\n"
+                 << "Usage: " << argv[0] << " [--scale N] [--books N] [--users N] [--history N] [--ops N] [--seed S] [--db FILE] [--reuse]\n"
+                 << "       [--lazy-cache-mb MB] [--group-commit] [--write-behind] [--oplog] [--max-loans N]\n"
+                 << "       [--workloads load,checkout,return,scan,columnar,circulation,incremental,save,recovery,drift] [--out FILE]\n";
+            return false;
+        }
+    }
+    if (!ops_set) o.ops = min<size_t>(10000, o.data.users);
+    o.ops = min(o.ops, o.data.users * o.max_loans);   // at most max_loans per user at a time
+    return true;
+}
+
+// Fixed key order and number formats, one workload per line, so two runs
+// can be diffed or compared by a script
+static void write_json(ostream& out, const BenchOptions& o, const vector<BenchResult>& results) {
+    out << fixed;
+    out << "{\"suite\":\"library_bench\",\"format\":1,\n"
+        << " \"config\":{\"books\":" << o.data.books << ",\"users\":" << o.data.users << ",\"history\":" << o.data.history
+        << ",\"ops\":" << o.ops << ",\"seed\":" << o.data.seed << ",\"mode\":\"" << (o.cache_mb ? "lazy" : "resident")
+        << "\",\"group_commit\":" << (o.group_commit ? "true" : "false")
+        << ",\"write_behind\":" << (o.write_behind ? "true" : "false")
+        << ",\"oplog\":" << (o.oplog ? "true" : "false") << ",\"max_loans\":" << o.max_loans << "},\n"
+        << " \"results\":{";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << (i ? ",\n" : "\n") << "  \"" << r.name << "\":{\"ops\":" << r.ops << ",\"ok\":" << r.ok << ",\"seconds\":"
+            << setprecision(6) << r.seconds << ",\"ops_per_sec\":" << setprecision(1) << (r.seconds > 0 ? (double)r.ops / r.seconds : 0.0);
+        if (r.timed_ops) {
+            const LatencyHistogram::Snapshot& s = r.latency;
+            out << setprecision(3) << ",\"mean_us\":" << (s.count ? (double)s.sum_ns / (double)s.count / 1000.0 : 0.0)
+                << ",\"p50_us\":" << s.quantile(0.50) / 1000.0 << ",\"p90_us\":" << s.quantile(0.90) / 1000.0
+                << ",\"p99_us\":" << s.quantile(0.99) / 1000.0 << ",\"max_us\":" << s.max_ns / 1000.0;
+        }
+        out << "}";
+    }
+    out << "\n }}\n";
+}
+
+// Columnar catalog against a map of Book objects: the books table as it
+// stands is loaded into a CatalogStore and an unordered_map<int, Book>,
+// then each gets the same full scans (copies on the shelf, books rated 4
+// or better), repeated to about two million rows, and as many random id
+// lookups. ok is ops only when both give the same answers.
+static bool run_columnar(const BenchOptions& o, vector<BenchResult>& results, string& err) {
+    CatalogStore store;
+    unordered_map<int, Book> books;
+    sqlite3* db = nullptr;
+    sqlite3_stmt* stmt = nullptr;
+    bool ok = sqlite3_open_v2(o.db_file.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK
+           && sqlite3_prepare_v2(db, "SELECT book_id, title, author, total_copies, available_copies, total_ratings, rating_sum, "
+                                     "stars_1, stars_2, stars_3, stars_4, stars_5 FROM books ORDER BY book_id;", -1, &stmt, nullptr) == SQLITE_OK;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        string title = Library::column_string(stmt, 1), author = Library::column_string(stmt, 2);
+        int total = sqlite3_column_int(stmt, 3), avail = sqlite3_column_int(stmt, 4);
+        RatingTally tally = Library::column_tally(stmt, 5);
+        store.upsert(id, title, author, total, avail, tally);
+        books.emplace(id, Book(id, title, author, total, avail, tally));
+    }
+    if (!ok) err = string("cannot read the catalog: ") + sqlite3_errmsg(db);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    if (!ok) return false;
+    if (books.empty()) {
+        err = "the catalog is empty";
+        return false;
+    }
+
+    size_t passes = max<size_t>(1, 2000000 / books.size());
+    size_t rows = passes * books.size();
+    long long col_scan = 0, map_scan = 0;
+    BenchResult col, objects;
+    col.name = "catalog_columns_scan";
+    objects.name = "catalog_map_scan";
+    auto start = chrono::steady_clock::now();
+    for (size_t p = 0; p < passes; p++) col_scan += store.sum_available_copies() + (long long)store.count_rated_at_least(4.0);
+    col.seconds = since(start);
+    start = chrono::steady_clock::now();
+    for (size_t p = 0; p < passes; p++) {
+        for (auto& e : books) {
+            const Book& b = e.second;
+            map_scan += b.availableCopies + (b.ratings.average() >= 4.0 && b.ratings.count >= 1);
+        }
+    }
+    objects.seconds = since(start);
+    col.ops = objects.ops = rows;
+    col.ok = objects.ok = col_scan == map_scan ? rows : 0;
+    results.push_back(col);
+    results.push_back(objects);
+
+    vector<int> keys(rows);
+    mt19937_64 rng(o.data.seed + 7);
+    for (int& k : keys) k = 1 + (int)(rng() % books.size());
+    long long col_find = 0, map_find = 0;
+    col = BenchResult();
+    objects = BenchResult();
+    col.name = "catalog_columns_lookup";
+    objects.name = "catalog_map_lookup";
+    start = chrono::steady_clock::now();
+    for (int id : keys) {
+        uint32_t slot = store.find(id);
+        if (slot != CatalogStore::NPOS) col_find += store.available_copies[slot] + (long long)store.title(slot).size();
+    }
+    col.seconds = since(start);
+    start = chrono::steady_clock::now();
+    for (int id : keys) {
+        auto it = books.find(id);
+        if (it != books.end()) map_find += it->second.availableCopies + (long long)it->second.title.size();
+    }
+    objects.seconds = since(start);
+    col.ops = objects.ops = rows;
+    col.ok = objects.ok = col_find == map_find ? rows : 0;
+    results.push_back(col);
+    results.push_back(objects);
+    cerr << "columnar: " << books.size() << " books, " << store.bytes() / 1024 << " KiB in columns; "
+         << passes << " scan passes, " << rows << " lookups\n";
+    return true;
+}
+
+// A fresh copy of the database at path (the workloads below must not
+// change the one the others share)
+static bool copy_database(const string& from, const string& path, string& err) {
+    for (const char* suffix : {"", "-wal", "-shm", ".oplog"}) remove((path + suffix).c_str());
+    sqlite3* src = nullptr;
+    bool ok = sqlite3_open(from.c_str(), &src) == SQLITE_OK;
+    sqlite3_stmt* stmt = nullptr;
+    ok = ok && sqlite3_prepare_v2(src, "VACUUM INTO ?;", -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+    ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) err = string("cannot copy the database: ") + sqlite3_errmsg(src);
+    sqlite3_finalize(stmt);
+    sqlite3_close(src);
+    return ok;
+}
+
+// Crash recovery: a child process issues loans on a copy of the database
+// with write-behind and the operation log on, reporting each acknowledged
+// issue over a pipe, and is SIGKILLed halfway through. The parent then
+// reopens the copy, which replays the log, and checks that every
+// acknowledged loan survived and the copy counts balance. ops counts the
+// acknowledged loans, ok those found, seconds the reopen including replay.
+static bool run_recovery(const BenchOptions& o, const LibraryConfig& base, time_t now, BenchResult& r, string& err) {
+#ifdef _WIN32
+    (void)o; (void)base; (void)now; (void)r;
+    err = "needs fork(); not available on Windows";
+    return false;
+#else
+    r.name = "crash_recovery";
+    string copy = o.db_file + ".recovery";
+    if (!copy_database(o.db_file, copy, err)) return false;
+
+    LibraryConfig cfg = base;
+    cfg.db_file = copy;
+    cfg.oplog_file = copy + ".oplog";
+    cfg.lazy_catalog = false;
+    cfg.group_commit = false;
+    cfg.write_behind = true;
+    cfg.write_behind_ms = 60000;   // only batch-size writes: most of the tail is still queued
+    cfg.notify = nullptr;
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        err = "pipe() failed";
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        err = "fork() failed";
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Library child(cfg);
+        mt19937_64 rng(o.data.seed + 5);
+        for (size_t i = 0; i < o.data.users; i++) {
+            int uid = (int)(o.data.users - i);   // from the top: the checkout workload used the low ids
+            OpResult res = child.issue_book(uid, SyntheticLibrary::pick_book(rng, o.data.books), now);
+            int32_t ack[2] = {uid, res.id};
+            if (res.ok && write(fds[1], ack, sizeof(ack)) != (ssize_t)sizeof(ack)) break;
+        }
+        close(fds[1]);
+        for (;;) pause();   // wait for the kill, never saving
+    }
+
+    close(fds[1]);
+    vector<pair<int, int>> acked;
+    int32_t ack[2];
+    bool killed = false;
+    while (read(fds[0], ack, sizeof(ack)) == (ssize_t)sizeof(ack)) {
+        acked.emplace_back(ack[0], ack[1]);
+        if (!killed && acked.size() >= o.ops / 2) {
+            kill(pid, SIGKILL);
+            killed = true;
+        }
+    }
+    if (!killed) kill(pid, SIGKILL);
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+
+    cfg.write_behind = false;
+    auto start = chrono::steady_clock::now();
+    Library lib(cfg);
+    r.seconds = since(start);
+    r.ops = acked.size();
+    string missing;   // the first 20 loans not found
+    size_t lost = 0;
+    for (auto& a : acked) {
+        IssuedRecord loan;
+        if (lib.loan_of(a.first, loan) && loan.issue_id() == a.second) {
+            r.ok++;
+        } else if (++lost <= 20) {
+            missing += (missing.empty() ? " issue " : ", issue ") + to_string(a.second) + " (user " + to_string(a.first) + ")";
+        }
+    }
+    OpResult audit = lib.audit_copies();
+    cerr << "recovery: " << acked.size() << " loans acknowledged before the kill, " << lib.log_recovery.replayed
+         << " operations replayed from the log, " << r.ok << " loans found; audit " << audit.message << "\n";
+    if (lost) {
+        err = to_string(lost) + " acknowledged loans are missing after recovery:" + missing + (lost > 20 ? " ..." : "");
+        return false;
+    }
+    if (!audit.ok) {
+        err = "copy counts do not balance after recovery: " + audit.message;
+        return false;
+    }
+    return true;
+#endif
+}
+
+// Copies taken behind the write-behind queue: loans are issued on a copy
+// of the database with write-behind on and held in the queue, every other
+// one is returned, and then another connection sets available_copies of
+// their books to 0. The queue finds no copy for those issues and drops
+// them; each loan must then be either in the issued table and in memory,
+// or in neither, never acknowledged in memory with no row behind it, and
+// the same must hold after a reopen. ops counts the loans, ok those whose
+// memory and table agree.
+static bool run_drift(const BenchOptions& o, const LibraryConfig& base, time_t now, BenchResult& r, string& err) {
+    r.name = "write_behind_drift";
+    string copy = o.db_file + ".drift";
+    if (!copy_database(o.db_file, copy, err)) return false;
+
+    LibraryConfig cfg = base;
+    cfg.db_file = copy;
+    cfg.oplog_file = copy + ".oplog";
+    cfg.lazy_catalog = false;
+    cfg.group_commit = false;
+    cfg.write_behind = true;
+    cfg.write_behind_ms = 60000;   // fewer jobs than a batch: nothing is written until the flush
+    size_t notices = 0;
+    cfg.notify = [&](const string&) { notices++; };
+
+    sqlite3* other = nullptr;
+    if (sqlite3_open(copy.c_str(), &other) != SQLITE_OK) {
+        err = string("cannot open the copy: ") + sqlite3_errmsg(other);
+        sqlite3_close(other);
+        return false;
+    }
+    sqlite3_busy_timeout(other, 5000);
+    auto in_table = [&](int issue_id) {
+        sqlite3_stmt* stmt = nullptr;
+        bool found = false;
+        if (sqlite3_prepare_v2(other, "SELECT 1 FROM issued WHERE issue_id = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, issue_id);
+            found = sqlite3_step(stmt) == SQLITE_ROW;
+        }
+        sqlite3_finalize(stmt);
+        return found;
+    };
+
+    struct Loan { int uid, book, issue_id; bool returned; };
+    vector<Loan> loans;
+    size_t cancelled = 0, bad = 0;
+    string mismatched;   // the first 20 loans whose memory and table disagree
+    auto check = [&](const Library& lib, const char* when) {
+        r.ok = 0;
+        cancelled = bad = 0;
+        mismatched.clear();
+        for (const Loan& l : loans) {
+            IssuedRecord loan;
+            bool held = lib.loan_of(l.uid, loan) && loan.issue_id() == l.issue_id;
+            bool written = in_table(l.issue_id);
+            if (held == written && !(l.returned && held)) {
+                r.ok++;
+                if (!l.returned && !held) cancelled++;
+            } else if (++bad <= 20) {
+                mismatched += (mismatched.empty() ? " issue " : ", issue ") + to_string(l.issue_id) + (held ? " (in memory only)" : " (in the table only)");
+            }
+        }
+        if (bad) err = to_string(bad) + " loans disagree between memory and the table " + when + ":" + mismatched + (bad > 20 ? " ..." : "");
+        return bad == 0;
+    };
+
+    bool ok = true;
+    {
+        Library lib(cfg);
+        mt19937_64 rng(o.data.seed + 7);
+        size_t want = min(o.ops, (size_t)256);   // issues and returns stay within one batch
+        for (size_t i = 0; i < o.data.users && loans.size() < want; i++) {
+            int uid = (int)(o.data.users - i);
+            int book = SyntheticLibrary::pick_book(rng, o.data.books);
+            OpResult res = lib.issue_book(uid, book, now);
+            if (res.ok) loans.push_back({uid, book, res.id, false});
+        }
+        for (size_t i = 0; i < loans.size(); i += 2) loans[i].returned = lib.return_book(loans[i].uid, 0, now, loans[i].book).ok;
+
+        sqlite3_stmt* take = nullptr;
+        ok = sqlite3_prepare_v2(other, "UPDATE books SET available_copies = 0 WHERE book_id = ?;", -1, &take, nullptr) == SQLITE_OK;
+        for (size_t i = 0; ok && i < loans.size(); i++) {
+            sqlite3_bind_int(take, 1, loans[i].book);
+            ok = sqlite3_step(take) == SQLITE_DONE;
+            sqlite3_reset(take);
+        }
+        if (!ok) err = string("cannot take the copies: ") + sqlite3_errmsg(other);
+        sqlite3_finalize(take);
+
+        auto start = chrono::steady_clock::now();
+        OpResult audit = lib.audit_copies();   // flushes the queue and cancels what it dropped
+        r.seconds = since(start);
+        r.ops = loans.size();
+        ok = ok && check(lib, "after the flush");
+        cerr << "drift: " << loans.size() << " loans queued, " << cancelled << " cancelled after their copies were taken, "
+             << notices << " notices; audit " << audit.message << "\n";
+    }
+    if (ok) {
+        cfg.write_behind = false;
+        cfg.notify = nullptr;
+        Library reopened(cfg);
+        ok = check(reopened, "after a reopen");
+    }
+    sqlite3_close(other);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions o;
+    if (!parse_bench_args(argc, argv, o)) return 1;
+
+    LibraryConfig cfg;
+    cfg.db_file = o.db_file;
+    cfg.group_commit = o.group_commit;
+    cfg.write_behind = o.write_behind;
+    cfg.max_loans = (int)o.max_loans;
+    if (o.oplog) cfg.oplog_file = o.db_file + ".oplog";
+    cfg.lazy_catalog = o.cache_mb > 0;
+    if (o.cache_mb) cfg.cache_bytes = o.cache_mb << 20;
+
+    time_t now = time(0);
+    vector<BenchResult> results;
+    if (!o.reuse || !ifstream(o.db_file)) {
+        for (const char* suffix : {"", "-wal", "-shm", ".oplog"}) remove((o.db_file + suffix).c_str());
+        { Library schema(cfg); }   // creates the tables and indexes
+        BenchResult r;
+        r.name = "generate";
+        string err;
+        if (!SyntheticLibrary::generate(o.db_file, o.data, now, r.ops, r.seconds, err)) {
+            cerr << "Generating " << o.db_file << " failed: " << err << "\n";
+            return 1;
+        }
+        r.ok = r.ops;
+        results.push_back(r);
+        cerr << "generate: " << r.ops << " rows in " << r.seconds << " s\n";
+    }
+
+    auto start = chrono::steady_clock::now();
+    Library lib(cfg);
+    BenchResult load;
+    load.name = "load";
+    load.seconds = since(start);
+    load.ops = load.ok = count_rows(o.db_file);
+    if (wants(o, "load")) results.push_back(load);
+
+    // Checkout storm: users from 1 up each borrow max_loans (mostly popular)
+    // books, ops loans in all
+    mt19937_64 rng(o.data.seed + 3);
+    vector<pair<int, int>> borrowers;   // (user, book) of each loan made
+    if (wants(o, "checkout") || wants(o, "return")) {
+        LatencyHistogram h;
+        BenchResult r;
+        r.name = "checkout_storm";
+        r.timed_ops = true;
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < o.ops; i++) {
+            int uid = (int)(i / o.max_loans) + 1;
+            int book = SyntheticLibrary::pick_book(rng, o.data.books);
+            auto t0 = chrono::steady_clock::now();
+            OpResult res = lib.issue_book(uid, book, now);
+            h.record(since_ns(t0));
+            if (res.ok) borrowers.emplace_back(uid, book);
+        }
+        lib.flush_group_commit();
+        r.seconds = since(start);
+        r.ops = o.ops;
+        r.ok = borrowers.size();
+        r.latency = h.snapshot();
+        if (wants(o, "checkout")) results.push_back(r);
+    }
+
+    // Return burst: every borrower returns, some late, most with a rating
+    if (wants(o, "return")) {
+        LatencyHistogram h;
+        BenchResult r;
+        r.name = "return_burst";
+        r.timed_ops = true;
+        start = chrono::steady_clock::now();
+        for (auto& loan : borrowers) {
+            time_t back = now + 86400 * (time_t)(1 + rng() % 20);
+            int rating = rng() % 4 ? 1 + (int)(rng() % 5) : 0;
+            auto t0 = chrono::steady_clock::now();
+            OpResult res = lib.return_book(loan.first, rating, back, loan.second);
+            h.record(since_ns(t0));
+            if (res.ok) r.ok++;
+        }
+        lib.flush_group_commit();
+        r.seconds = since(start);
+        r.ops = borrowers.size();
+        r.latency = h.snapshot();
+        results.push_back(r);
+    }
+
+    // Catalog scan: render the full book and user lists into a discarding stream
+    if (wants(o, "scan")) {
+        LibraryConsole::DiscardBuf sink;
+        ostream out(&sink);
+        LibraryConsole console(lib);
+        BenchResult r;
+        r.name = "catalog_scan";
+        start = chrono::steady_clock::now();
+        {
+            TableWriter w(out);
+            console.writeBookTable(w);
+            console.writeUserTable(w, now);
+            r.ops = r.ok = w.rows_written();
+        }
+        r.seconds = since(start);
+        results.push_back(r);
+    }
+
+    if (wants(o, "columnar")) {
+        string err;
+        if (!run_columnar(o, results, err)) {
+            cerr << "columnar: " << err << "\n";
+            return 1;
+        }
+    }
+
+    // Circulation report: a full aggregation over history
+    if (wants(o, "circulation")) {
+        CirculationSummary::RefreshStats stats;
+        double ms = 0;
+        BenchResult r;
+        r.name = "circulation_report";
+        bool ok = lib.refresh_circulation(stats, ms);
+        r.seconds = ms / 1000.0;
+        r.ops = stats.rows;
+        r.ok = ok ? stats.rows : 0;
+        results.push_back(r);
+    }
+
+    // Incremental saves: 1, 100 and 10000 changed rows (as many as are
+    // resident, at most), each saved on its own. Save cost should follow
+    // the changed rows, not the size of the tables.
+    if (wants(o, "incremental")) {
+        lib.save_all();   // nothing pending from the workloads before
+        for (size_t n : {(size_t)1, (size_t)100, (size_t)10000}) {
+            BenchResult r;
+            r.name = "save_dirty_" + to_string(n);
+            size_t marked = lib.mark_rows_dirty(n);
+            start = chrono::steady_clock::now();
+            int rows = lib.save_all();
+            r.seconds = since(start);
+            r.ops = rows > 0 ? (size_t)rows : 0;
+            r.ok = rows >= 0 ? r.ops : 0;
+            results.push_back(r);
+            if (marked < n) break;   // every resident row was in this save
+        }
+    }
+
+    // Full save: every resident book and user rewritten in one transaction
+    if (wants(o, "save")) {
+        BenchResult r;
+        r.name = "full_save";
+        lib.mark_all_dirty();
+        start = chrono::steady_clock::now();
+        int rows = lib.save_all();
+        r.seconds = since(start);
+        r.ops = rows > 0 ? (size_t)rows : 0;
+        r.ok = rows >= 0 ? r.ops : 0;
+        results.push_back(r);
+    }
+
+    if (wants(o, "recovery")) {
+        BenchResult r;
+        string err;
+        if (!run_recovery(o, cfg, now, r, err)) {
+            cerr << "recovery: " << err << "\n";
+            return 1;
+        }
+        results.push_back(r);
+    }
+
+    if (wants(o, "drift")) {
+        BenchResult r;
+        string err;
+        if (!run_drift(o, cfg, now, r, err)) {
+            cerr << "drift: " << err << "\n";
+            return 1;
+        }
+        results.push_back(r);
+    }
+
+    if (o.out_file.empty()) {
+        write_json(cout, o, results);
+    } else {
+        ofstream out(o.out_file);
+        write_json(out, o, results);
+        if (!out) {
+            cerr << "Cannot write " << o.out_file << "\n";
+            return 1;
+        }
+        cerr << "Results written to " << o.out_file << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+#ifndef SYNTHETIC_LIBRARY_H
+#define SYNTHETIC_LIBRARY_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <string>
+#include "../src/statement_cache.h"
+#include "sqlite3.h"
+
+// ----------------------
+// SyntheticLibrary: fills a library database with a reproducible catalog,
+// user base and circulation history. The same seed and sizes always give
+// the same rows.
+// - books: ~1 distinct author per 8 books, 1-5 copies, all on the shelf,
+//   and a random rating tally for most of them
+// - users: 3% are defaulters with a penalty still running
+// - history: closed loans spread evenly over `history_days` up to `now`,
+//   oldest first, so issue_id grows with time as in a real library. Book
+//   choice is skewed (pick_book). 85% come back within the 15-day loan
+//   period; the rest come back late with status "defaulter".
+// The schema must already exist (Library creates it). Rows are bulk
+// inserted in one transaction with the rollback journal and fsync off;
+// the journal mode is restored afterwards.
+// ----------------------
+class SyntheticLibrary {
+public:
+    struct Options {
+        size_t books = 10000;
+        size_t users = 10000;
+        size_t history = 20000;
+        int history_days = 730;
+        uint64_t seed = 42;
+    };
+
+    // Popular books get most loans: id = 1 + books * u^4, so the first
+    // fifth of the catalog takes about two thirds of them
+    static int pick_book(std::mt19937_64& rng, size_t books) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        size_t id = (size_t)((double)books * u * u * u * u);
+        return (int)(id < books ? id : books - 1) + 1;
+    }
+
+    static std::string title_of(size_t id) {
+        static const char* adjectives[] = {"Silent", "Hidden", "Broken", "Golden", "Last", "Distant", "Crimson", "Quiet",
+                                           "Wandering", "Frozen", "Burning", "Lost", "Secret", "Endless", "Pale", "Iron"};
+        static const char* nouns[] = {"River", "Kingdom", "Garden", "Machine", "Harbor", "Archive", "Mountain", "Letter",
+                                      "Empire", "Forest", "Signal", "Orchard", "Lantern", "Voyage", "Citadel", "Atlas"};
+        char buf[96];
+        snprintf(buf, sizeof(buf), "The %s %s %zu", adjectives[id % 16], nouns[(id / 16) % 16], id);
+        return buf;
+    }
+
+    static std::string author_of(size_t author) {
+        static const char* first[] = {"Ada", "Boris", "Chloe", "Dmitri", "Elena", "Farid", "Greta", "Hugo", "Ines", "Jonas",
+                                      "Kira", "Liam", "Mara", "Nils", "Olga", "Pavel", "Quinn", "Rosa", "Sven", "Tara"};
+        static const char* last[] = {"Abbott", "Brandt", "Castro", "Duval", "Eriksen", "Fischer", "Garcia", "Hale", "Ivanova",
+                                     "Jensen", "Kowalski", "Lindqvist", "Moreau", "Novak", "Okafor", "Petrov", "Quade",
+                                     "Rossi", "Silva", "Tanaka", "Ueda", "Varga", "Weber", "Xu", "Young"};
+        std::string name = std::string(first[author % 20]) + " " + last[(author / 20) % 25];
+        if (author >= 500) name += " " + std::to_string(author / 500 + 1);
+        return name;
+    }
+
+    // Rows inserted and time taken; false with err set on failure
+    static bool generate(const std::string& path, const Options& o, time_t now, size_t& rows, double& seconds, std::string& err) {
+        auto start = std::chrono::steady_clock::now();
+        rows = 0;
+        sqlite3* db = nullptr;
+        if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+            err = "cannot open " + path;
+            sqlite3_close(db);
+            return false;
+        }
+        bool ok = exec(db, "PRAGMA journal_mode = DELETE; PRAGMA synchronous = OFF; PRAGMA cache_size = -262144;", err)
+               && exec(db, "BEGIN; DELETE FROM issued; DELETE FROM history; DELETE FROM users; DELETE FROM books;", err);
+        {
+            StatementCache stmts(db);
+            ok = ok && fill_books(stmts, o, rows, err) && fill_users(stmts, o, now, rows, err)
+                    && fill_history(stmts, o, now, rows, err);
+            if (ok) {
+                std::string seq = "DELETE FROM sqlite_sequence WHERE name = 'issued';"
+                                  "INSERT INTO sqlite_sequence (name, seq) VALUES ('issued', " + std::to_string(o.history) + ");";
+                ok = exec(db, seq.c_str(), err);
+            }
+        }
+        ok = ok && exec(db, "COMMIT; ANALYZE; PRAGMA journal_mode = WAL;", err);
+        if (!ok) sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        sqlite3_close(db);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return ok;
+    }
+
+private:
+    static bool exec(sqlite3* db, const char* sql, std::string& err) {
+        char* msg = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &msg) == SQLITE_OK) return true;
+        err = msg ? msg : sqlite3_errmsg(db);
+        sqlite3_free(msg);
+        return false;
+    }
+
+    static bool step(StmtGuard& st, size_t& rows, std::string& err) {
+        if (!st.run()) {
+            err = sqlite3_errmsg(sqlite3_db_handle(st.get()));
+            return false;
+        }
+        rows++;
+        return true;
+    }
+
+    static bool fill_books(StatementCache& stmts, const Options& o, size_t& rows, std::string& err) {
+        std::mt19937_64 rng(o.seed);
+        size_t authors = o.books / 8 + 1;
+        StmtGuard st(stmts.get("INSERT INTO books (book_id, title, author, total_copies, available_copies, avg_rating, "
+                               "total_ratings, rating_sum, stars_1, stars_2, stars_3, stars_4, stars_5) "
+                               "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);"));
+        if (!st) {
+            err = "cannot prepare the book insert";
+            return false;
+        }
+        sqlite3_stmt* stmt = st.get();
+        for (size_t id = 1; id <= o.books; id++) {
+            std::string title = title_of(id), author = author_of(rng() % authors);
+            int copies = 1 + (int)(rng() % 5);
+            int stars[5] = {0, 0, 0, 0, 0};
+            int count = rng() % 10 < 7 ? (int)(rng() % 40) : 0;
+            int64_t sum = 0;
+            for (int r = 0; r < count; r++) {
+                int s = 1 + (int)(rng() % 3) + (int)(rng() % 3);   // 1-5, centred on 3
+                stars[s - 1]++;
+                sum += s;
+            }
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+            sqlite3_bind_text(stmt, 2, title.c_str(), (int)title.size(), SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, author.c_str(), (int)author.size(), SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 4, copies);
+            sqlite3_bind_int(stmt, 5, copies);
+            sqlite3_bind_double(stmt, 6, count ? (double)sum / count : 0.0);
+            sqlite3_bind_int(stmt, 7, count);
+            sqlite3_bind_int64(stmt, 8, sum);
+            for (int s = 0; s < 5; s++) sqlite3_bind_int(stmt, 9 + s, stars[s]);
+            if (!step(st, rows, err)) return false;
+        }
+        return true;
+    }
+
+    static bool fill_users(StatementCache& stmts, const Options& o, time_t now, size_t& rows, std::string& err) {
+        std::mt19937_64 rng(o.seed + 1);
+        StmtGuard st(stmts.get("INSERT INTO users (user_id, name, is_defaulter, penalty_end) VALUES (?, ?, ?, ?);"));
+        if (!st) {
+            err = "cannot prepare the user insert";
+            return false;
+        }
+        sqlite3_stmt* stmt = st.get();
+        for (size_t id = 1; id <= o.users; id++) {
+            std::string name = "Member " + std::to_string(id);
+            bool defaulter = rng() % 100 < 3;
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+            sqlite3_bind_text(stmt, 2, name.c_str(), (int)name.size(), SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 3, defaulter ? 1 : 0);
+            sqlite3_bind_int64(stmt, 4, defaulter ? (sqlite3_int64)(now + 86400 * (1 + (int64_t)(rng() % 14))) : 0);
+            if (!step(st, rows, err)) return false;
+        }
+        return true;
+    }
+
+    static bool fill_history(StatementCache& stmts, const Options& o, time_t now, size_t& rows, std::string& err) {
+        if (o.books == 0 || o.users == 0) return true;
+        std::mt19937_64 rng(o.seed + 2);
+        const int64_t day = 86400;
+        // Leave room for the latest loans to come back before now
+        int64_t span = (int64_t)o.history_days * day, first = (int64_t)now - span - 40 * day;
+        StmtGuard st(stmts.get("INSERT INTO history (issue_id, book_id, user_id, title, author, issue_datetime, return_datetime, status) "
+                               "SELECT ?1, ?2, ?3, title, author, ?4, ?5, ?6 FROM books WHERE book_id = ?2;"));
+        if (!st) {
+            err = "cannot prepare the history insert";
+            return false;
+        }
+        sqlite3_stmt* stmt = st.get();
+        for (size_t id = 1; id <= o.history; id++) {
+            int64_t issued = first + (int64_t)((double)span * (double)(id - 1) / (double)o.history) + (int64_t)(rng() % 3600);
+            bool late = rng() % 100 < 15;
+            int64_t kept = late ? (16 + (int64_t)(rng() % 25)) * day : (1 + (int64_t)(rng() % 15)) * day - 3600;
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+            sqlite3_bind_int(stmt, 2, pick_book(rng, o.books));
+            sqlite3_bind_int64(stmt, 3, (sqlite3_int64)(1 + rng() % o.users));
+            sqlite3_bind_int64(stmt, 4, issued);
+            sqlite3_bind_int64(stmt, 5, issued + kept);
+            sqlite3_bind_text(stmt, 6, late ? "defaulter" : "returned", -1, SQLITE_STATIC);
+            if (!step(st, rows, err)) return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -8,7 +8,7 @@ if not exist build (
     mkdir build
 )
 
-g++ -std=c++17 -O2 -Wall "%SRC%" -o "%OUT%" -lsqlite3
+g++ -std=c++17 -O2 -Wall "%SRC%" -o "%OUT%" -lsqlite3 -pthread
 
 if %errorlevel% neq 0 (
     echo.
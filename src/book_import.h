@@ -0,0 +1,150 @@
+#ifndef BOOK_IMPORT_H
+#define BOOK_IMPORT_H
+
+#include <cerrno>
+#include <cstdlib>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ----------------------
+// Bulk catalog import: parsing side.
+// Input is one book per line, `title,author,copies`, comma- or
+// tab-separated. Fields may be double-quoted ("" is a literal quote), but a
+// record may not span lines, so the file can be cut into chunks at any
+// newline and the chunks parsed independently.
+// ----------------------
+struct ImportRow {
+    std::string title;
+    std::string author;
+    int copies;
+};
+
+struct ParsedChunk {
+    std::vector<ImportRow> rows;
+    std::vector<std::pair<size_t, std::string>> errors;   // (line within chunk, reason)
+    size_t lines = 0;
+};
+
+// Reads a stream in large blocks that always end on a line boundary
+class ChunkReader {
+private:
+    std::istream& in;
+    size_t block;
+    std::string carry;   // partial last line of the previous block
+
+public:
+    ChunkReader(std::istream& s, size_t blockBytes = 8u << 20) : in(s), block(blockBytes) {
+
+    }
+
+    // Next chunk of whole lines; false once the input is exhausted
+    bool next(std::string& out) {
+        out.swap(carry);
+        carry.clear();
+        size_t have = out.size();
+        out.resize(have + block);
+        in.read(&out[have], (std::streamsize)block);
+        out.resize(have + (size_t)in.gcount());
+        if (out.empty()) return false;
+        if (in) {
+            size_t nl = out.rfind('\n');
+            if (nl != std::string::npos) {
+                carry.assign(out, nl + 1, std::string::npos);
+                out.resize(nl + 1);
+            }
+        }
+        return true;
+    }
+};
+
+class BookCsv {
+private:
+    // Split one record into fields; false on an unterminated quote
+    static bool split(const char* p, const char* end, char delim, std::vector<std::string>& fields) {
+        fields.clear();
+        std::string cur;
+        while (true) {
+            cur.clear();
+            if (p < end && *p == '"') {
+                p++;
+                while (true) {
+                    if (p == end) return false;
+                    if (*p == '"') {
+                        if (p + 1 < end && p[1] == '"') { cur += '"'; p += 2; continue; }
+                        p++;
+                        break;
+                    }
+                    cur += *p++;
+                }
+                while (p < end && *p != delim) p++;   // ignore anything after the closing quote
+            } else {
+                const char* s = p;
+                while (p < end && *p != delim) p++;
+                cur.assign(s, p);
+            }
+            fields.push_back(trim(cur));
+            if (p == end) return true;
+            p++;   // delimiter
+        }
+    }
+
+    static std::string trim(const std::string& s) {
+        size_t b = s.find_first_not_of(" \t");
+        if (b == std::string::npos) return "";
+        size_t e = s.find_last_not_of(" \t");
+        return s.substr(b, e - b + 1);
+    }
+
+public:
+    // Tab if the sample's first line has one, else comma
+    static char detect_delimiter(const std::string& sample) {
+        size_t nl = sample.find('\n');
+        return sample.find('\t') < nl ? '\t' : ',';
+    }
+
+    // Header rows are recognised by a non-numeric copies column named "copies"
+    static bool is_header(const std::string& line, char delim) {
+        std::vector<std::string> f;
+        if (!split(line.data(), line.data() + line.size(), delim, f) || f.size() != 3) return false;
+        return f[2].find("copies") != std::string::npos || f[2].find("Copies") != std::string::npos;
+    }
+
+    static ParsedChunk parse(const std::string& text, char delim) {
+        ParsedChunk out;
+        out.rows.reserve(text.size() / 40);
+        std::vector<std::string> fields;
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            const char* eol = p;
+            while (eol < end && *eol != '\n') eol++;
+            const char* line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+            size_t line = ++out.lines;
+
+            if (line_end > p) {
+                if (!split(p, line_end, delim, fields)) {
+                    out.errors.emplace_back(line, "unterminated quote");
+                } else if (fields.size() != 3) {
+                    out.errors.emplace_back(line, "expected 3 fields, found " + std::to_string(fields.size()));
+                } else if (fields[0].empty()) {
+                    out.errors.emplace_back(line, "empty title");
+                } else {
+                    char* num_end = nullptr;
+                    errno = 0;
+                    long copies = std::strtol(fields[2].c_str(), &num_end, 10);
+                    if (fields[2].empty() || *num_end != '\0' || errno == ERANGE || copies <= 0 || copies > 1000000) {
+                        out.errors.emplace_back(line, "invalid copies '" + fields[2] + "'");
+                    } else {
+                        out.rows.push_back({std::move(fields[0]), std::move(fields[1]), (int)copies});
+                    }
+                }
+            }
+            p = eol < end ? eol + 1 : end;
+        }
+        return out;
+    }
+};
+
+#endif
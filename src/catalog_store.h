@@ -0,0 +1,343 @@
+#ifndef CATALOG_STORE_H
+#define CATALOG_STORE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ratings.h"
+
+// ----------------------
+// StringPool: interned strings packed into one growing arena.
+// Strings are referenced by a 32-bit handle; equal strings share a handle.
+// The hash table stores handles only, so each distinct string costs its
+// bytes plus a few words of bookkeeping. Nothing is freed individually.
+// ----------------------
+class StringPool {
+private:
+    std::vector<char> arena;
+    std::vector<uint32_t> offset;   // handle -> start in arena
+    std::vector<uint32_t> length;   // handle -> byte length
+    std::vector<uint32_t> table;    // open addressing; 0 = empty, else handle + 1
+
+    static uint32_t hash(std::string_view s) {
+        uint32_t h = 2166136261u;   // FNV-1a
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    void grow() {
+        std::vector<uint32_t> old;
+        old.swap(table);
+        table.assign(old.empty() ? 1024 : old.size() * 2, 0);
+        size_t mask = table.size() - 1;
+        for (uint32_t e : old) {
+            if (!e) continue;
+            size_t i = hash(view(e - 1)) & mask;
+            while (table[i]) i = (i + 1) & mask;
+            table[i] = e;
+        }
+    }
+
+public:
+    std::string_view view(uint32_t handle) const {
+        return std::string_view(arena.data() + offset[handle], length[handle]);
+    }
+
+    uint32_t intern(std::string_view s) {
+        if ((offset.size() + 1) * 2 > table.size()) grow();   // keep load factor <= 0.5
+        size_t mask = table.size() - 1;
+        size_t i = hash(s) & mask;
+        while (table[i]) {
+            uint32_t h = table[i] - 1;
+            if (view(h) == s) return h;
+            i = (i + 1) & mask;
+        }
+        uint32_t handle = (uint32_t)offset.size();
+        offset.push_back((uint32_t)arena.size());
+        length.push_back((uint32_t)s.size());
+        arena.insert(arena.end(), s.begin(), s.end());
+        table[i] = handle + 1;
+        return handle;
+    }
+
+    size_t count() const {
+        return offset.size();
+    }
+
+    size_t bytes() const {
+        return arena.capacity() + (offset.capacity() + length.capacity() + table.capacity()) * sizeof(uint32_t);
+    }
+
+    void clear() {
+        arena.clear();
+        offset.clear();
+        length.clear();
+        table.clear();
+    }
+};
+
+// ----------------------
+// CopyCounter: one book's available-copy count. Copies are taken and given
+// back with compare-and-swap, so threads holding only a shared lock on the
+// catalog can claim copies of the same book without oversubscribing it.
+// Copy construction (used when a column grows, under an exclusive lock)
+// snapshots the value.
+// ----------------------
+class CopyCounter {
+private:
+    std::atomic<int> n;
+
+public:
+    CopyCounter(int v = 0) : n(v) {
+
+    }
+    CopyCounter(const CopyCounter& o) : n(o.load()) {
+
+    }
+    CopyCounter& operator=(const CopyCounter& o) {
+        n.store(o.load(), std::memory_order_relaxed);
+        return *this;
+    }
+    CopyCounter& operator=(int v) {
+        n.store(v, std::memory_order_relaxed);
+        return *this;
+    }
+
+    int load() const {
+        return n.load(std::memory_order_acquire);
+    }
+    operator int() const {
+        return load();
+    }
+
+    // Take one copy if any is left
+    bool try_take() {
+        int v = n.load(std::memory_order_relaxed);
+        while (v > 0) {
+            if (n.compare_exchange_weak(v, v - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+
+    // Put one copy back, never going above limit
+    bool give_back(int limit) {
+        int v = n.load(std::memory_order_relaxed);
+        while (v < limit) {
+            if (n.compare_exchange_weak(v, v + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+};
+
+// ----------------------
+// CatalogStore: the book catalog as parallel column arrays (struct of
+// arrays). Row `slot` of every column describes one book; titles and
+// authors are handles into a shared StringPool. Ids map to slots through
+// a dense array (book ids are AUTOINCREMENT, so they are compact), with a
+// hash map for any id too large for it. Removing a book moves the last
+// row into its slot, keeping the columns dense for scans.
+// ----------------------
+class CatalogStore {
+public:
+    static constexpr uint32_t NPOS = 0xFFFFFFFFu;
+
+    // Plain columns, exposed read-only for scans
+    std::vector<int> ids;
+    std::vector<int> total_copies;
+    std::vector<CopyCounter> available_copies;   // the only column written under a shared lock
+    std::vector<double> avg_rating;                 // rating_sum / total_ratings, kept for scans
+    std::vector<int> total_ratings;
+    std::vector<int64_t> rating_sum;
+    std::vector<std::array<int, 5>> star_counts;
+    std::vector<uint8_t> dirty;
+
+private:
+    std::vector<uint32_t> title_ref;
+    std::vector<uint32_t> author_ref;
+    StringPool strings;
+
+    std::vector<uint32_t> dense_slot;                 // id -> slot for small ids
+    std::unordered_map<int, uint32_t> sparse_slot;    // everything else
+    static constexpr int DENSE_LIMIT = 1 << 26;
+
+    void set_slot(int id, uint32_t slot) {
+        if (id >= 0 && id < DENSE_LIMIT) {
+            if ((size_t)id >= dense_slot.size()) dense_slot.resize((size_t)id + 1 + dense_slot.size() / 2, NPOS);
+            dense_slot[id] = slot;
+        } else {
+            sparse_slot[id] = slot;
+        }
+    }
+
+    void clear_slot(int id) {
+        if (id >= 0 && id < DENSE_LIMIT) {
+            if ((size_t)id < dense_slot.size()) dense_slot[id] = NPOS;
+        } else {
+            sparse_slot.erase(id);
+        }
+    }
+
+public:
+    size_t size() const {
+        return ids.size();
+    }
+
+    uint32_t find(int id) const {
+        if (id >= 0 && id < DENSE_LIMIT) {
+            return (size_t)id < dense_slot.size() ? dense_slot[id] : NPOS;
+        }
+        auto it = sparse_slot.find(id);
+        return it == sparse_slot.end() ? NPOS : it->second;
+    }
+
+    void reserve(size_t n) {
+        ids.reserve(n);
+        total_copies.reserve(n);
+        available_copies.reserve(n);
+        avg_rating.reserve(n);
+        total_ratings.reserve(n);
+        rating_sum.reserve(n);
+        star_counts.reserve(n);
+        dirty.reserve(n);
+        title_ref.reserve(n);
+        author_ref.reserve(n);
+    }
+
+    std::string_view title(uint32_t slot) const {
+        return strings.view(title_ref[slot]);
+    }
+    std::string_view author(uint32_t slot) const {
+        return strings.view(author_ref[slot]);
+    }
+
+    RatingTally ratings(uint32_t slot) const {
+        RatingTally r;
+        r.sum = rating_sum[slot];
+        r.count = total_ratings[slot];
+        r.stars = star_counts[slot];
+        return r;
+    }
+
+    // Insert a book, or overwrite the row of an existing id; returns its slot
+    uint32_t upsert(int id, std::string_view t, std::string_view a, int total, int avail, const RatingTally& r) {
+        uint32_t slot = find(id);
+        if (slot == NPOS) {
+            slot = (uint32_t)ids.size();
+            ids.push_back(id);
+            total_copies.push_back(total);
+            available_copies.push_back(avail);
+            avg_rating.push_back(r.average());
+            total_ratings.push_back(r.count);
+            rating_sum.push_back(r.sum);
+            star_counts.push_back(r.stars);
+            dirty.push_back(0);
+            title_ref.push_back(strings.intern(t));
+            author_ref.push_back(strings.intern(a));
+            set_slot(id, slot);
+            return slot;
+        }
+        total_copies[slot] = total;
+        available_copies[slot] = avail;
+        avg_rating[slot] = r.average();
+        total_ratings[slot] = r.count;
+        rating_sum[slot] = r.sum;
+        star_counts[slot] = r.stars;
+        if (title(slot) != t) title_ref[slot] = strings.intern(t);
+        if (author(slot) != a) author_ref[slot] = strings.intern(a);
+        return slot;
+    }
+
+    bool erase(int id) {
+        uint32_t slot = find(id);
+        if (slot == NPOS) return false;
+        uint32_t last = (uint32_t)ids.size() - 1;
+        if (slot != last) {
+            ids[slot] = ids[last];
+            total_copies[slot] = total_copies[last];
+            available_copies[slot] = available_copies[last];
+            avg_rating[slot] = avg_rating[last];
+            total_ratings[slot] = total_ratings[last];
+            rating_sum[slot] = rating_sum[last];
+            star_counts[slot] = star_counts[last];
+            dirty[slot] = dirty[last];
+            title_ref[slot] = title_ref[last];
+            author_ref[slot] = author_ref[last];
+            set_slot(ids[slot], slot);
+        }
+        ids.pop_back();
+        total_copies.pop_back();
+        available_copies.pop_back();
+        avg_rating.pop_back();
+        total_ratings.pop_back();
+        rating_sum.pop_back();
+        star_counts.pop_back();
+        dirty.pop_back();
+        title_ref.pop_back();
+        author_ref.pop_back();
+        clear_slot(id);
+        return true;
+    }
+
+    void clear() {
+        ids.clear();
+        total_copies.clear();
+        available_copies.clear();
+        avg_rating.clear();
+        total_ratings.clear();
+        rating_sum.clear();
+        star_counts.clear();
+        dirty.clear();
+        title_ref.clear();
+        author_ref.clear();
+        strings.clear();
+        dense_slot.clear();
+        sparse_slot.clear();
+    }
+
+    // Approximate heap footprint of the whole store
+    size_t bytes() const {
+        size_t per_row = sizeof(int) * 4 + sizeof(double) + sizeof(int64_t) + sizeof(std::array<int, 5>) + sizeof(uint8_t) + sizeof(uint32_t) * 2;
+        return ids.capacity() * per_row + strings.bytes() + dense_slot.capacity() * sizeof(uint32_t)
+             + sparse_slot.size() * (sizeof(int) + sizeof(uint32_t) + 2 * sizeof(void*));
+    }
+
+    size_t distinct_strings() const {
+        return strings.count();
+    }
+
+    // ---- Column scans ----
+    long long sum_total_copies() const {
+        long long n = 0;
+        for (int v : total_copies) n += v;
+        return n;
+    }
+
+    long long sum_available_copies() const {
+        long long n = 0;
+        for (int v : available_copies) n += v;
+        return n;
+    }
+
+    size_t count_available() const {
+        size_t n = 0;
+        for (int v : available_copies) n += v > 0;
+        return n;
+    }
+
+    size_t count_rated_at_least(double min_rating, int min_ratings = 1) const {
+        size_t n = 0;
+        for (size_t i = 0; i < avg_rating.size(); i++) {
+            n += (avg_rating[i] >= min_rating) & (total_ratings[i] >= min_ratings);
+        }
+        return n;
+    }
+};
+
+#endif
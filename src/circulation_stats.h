@@ -0,0 +1,324 @@
+#ifndef CIRCULATION_STATS_H
+#define CIRCULATION_STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "catalog_store.h"
+#include "connection_pool.h"
+#include "sqlite3.h"
+
+// ----------------------
+// Circulation analytics over history (all partitions).
+// A CirculationSummary holds the aggregates behind the reports: loans per
+// day, loans and overdue returns per author, loans per title, and total
+// loan time. Building it splits every history partition into issue_id
+// ranges; worker threads, each on its own read connection, scan ranges in
+// column chunks into private partial results that are merged at the end.
+// The summary remembers the last issue_id it has seen and the loans that
+// were still out, so a refresh reads only newer rows and re-checks those
+// loans instead of starting over.
+// ----------------------
+class CirculationSummary {
+public:
+    struct AuthorStats {
+        int64_t loans = 0;
+        int64_t closed = 0;    // returned
+        int64_t overdue = 0;   // returned late
+    };
+    struct RefreshStats {
+        size_t rows = 0;          // history rows scanned
+        size_t closed = 0;        // previously open loans found returned
+        size_t threads = 0;
+        bool full = false;
+    };
+
+private:
+    static constexpr size_t CHUNK_ROWS = 16384;
+
+    struct OpenLoan {
+        int64_t issued;
+        std::string author;
+    };
+
+    // One worker's view: column chunk plus partial aggregates keyed by
+    // handles into its own string pool
+    class Scanner {
+    private:
+        StringPool strings;
+        std::unordered_map<uint32_t, uint32_t> title_slot, author_slot;   // handle -> partial slot
+
+        // Column chunk
+        std::vector<int64_t> issue_id, issued, returned;
+        std::vector<uint8_t> status;   // 0 out, 1 returned, 2 returned late
+        std::vector<uint32_t> title, author;
+
+    public:
+        // Partial aggregates
+        std::vector<uint32_t> title_handle, author_handle;
+        std::vector<int64_t> title_loans;
+        std::vector<AuthorStats> authors;
+        std::unordered_map<int64_t, int64_t> per_day;
+        int64_t closed = 0, loan_seconds = 0, max_id = std::numeric_limits<int64_t>::min();
+        std::vector<std::pair<int64_t, OpenLoan>> open;
+        size_t rows = 0;
+
+        std::string_view text(uint32_t handle) const {
+            return strings.view(handle);
+        }
+
+        static uint8_t status_code(const unsigned char* s) {
+            if (!s) return 0;
+            std::string_view v((const char*)s);
+            if (v == "returned") return 1;
+            if (v == "defaulter") return 2;
+            return 0;
+        }
+
+        uint32_t slot_of(std::unordered_map<uint32_t, uint32_t>& slots, std::vector<uint32_t>& handles, uint32_t h) {
+            auto it = slots.find(h);
+            if (it != slots.end()) return it->second;
+            uint32_t s = (uint32_t)handles.size();
+            slots.emplace(h, s);
+            handles.push_back(h);
+            return s;
+        }
+
+        void aggregate_chunk() {
+            size_t n = issue_id.size();
+            for (size_t i = 0; i < n; i++) {
+                uint32_t t = slot_of(title_slot, title_handle, title[i]);
+                if (t == title_loans.size()) title_loans.push_back(0);
+                title_loans[t]++;
+                uint32_t a = slot_of(author_slot, author_handle, author[i]);
+                if (a == authors.size()) authors.emplace_back();
+                AuthorStats& as = authors[a];
+                as.loans++;
+                per_day[issued[i] >= 0 ? issued[i] / 86400 : (issued[i] - 86399) / 86400]++;
+                if (status[i] == 0) {
+                    open.push_back({issue_id[i], OpenLoan{issued[i], std::string(strings.view(author[i]))}});
+                } else {
+                    as.closed++;
+                    as.overdue += status[i] == 2;
+                    closed++;
+                    loan_seconds += std::max<int64_t>(0, returned[i] - issued[i]);
+                }
+                max_id = std::max(max_id, issue_id[i]);
+            }
+            rows += n;
+            issue_id.clear(); issued.clear(); returned.clear();
+            status.clear(); title.clear(); author.clear();
+        }
+
+        // Scan issue_id in (lo, hi] of table
+        bool scan(const ConnectionPool::Lease& conn, const std::string& table, int64_t lo, int64_t hi) {
+            std::string sql = "SELECT issue_id, issue_datetime, return_datetime, status, title, author FROM " + table
+                            + " WHERE issue_id > ? AND issue_id <= ?;";
+            StmtGuard st = conn.prepared(sql.c_str());
+            if (!st) return false;
+            sqlite3_stmt* stmt = st.get();
+            sqlite3_bind_int64(stmt, 1, lo);
+            sqlite3_bind_int64(stmt, 2, hi);
+            int rc;
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                issue_id.push_back(sqlite3_column_int64(stmt, 0));
+                issued.push_back(sqlite3_column_int64(stmt, 1));
+                returned.push_back(sqlite3_column_int64(stmt, 2));
+                status.push_back(status_code(sqlite3_column_text(stmt, 3)));
+                title.push_back(strings.intern(column_view(stmt, 4)));
+                author.push_back(strings.intern(column_view(stmt, 5)));
+                if (issue_id.size() == CHUNK_ROWS) aggregate_chunk();
+            }
+            aggregate_chunk();
+            return rc == SQLITE_DONE;
+        }
+
+        static std::string_view column_view(sqlite3_stmt* stmt, int col) {
+            const unsigned char* t = sqlite3_column_text(stmt, col);
+            return t ? std::string_view((const char*)t, (size_t)sqlite3_column_bytes(stmt, col)) : std::string_view();
+        }
+    };
+
+    struct Range {
+        const std::string* table;
+        int64_t lo, hi;
+    };
+
+    std::map<int64_t, int64_t> loans_per_day;   // UTC day number -> loans issued
+    std::unordered_map<std::string, AuthorStats> authors;
+    std::unordered_map<std::string, int64_t> titles;
+    std::unordered_map<int64_t, OpenLoan> open;   // issue_id -> loan still out at the last refresh
+    int64_t total_loans = 0;
+    int64_t closed_loans = 0;
+    int64_t loan_seconds = 0;
+    int64_t last_issue_id = std::numeric_limits<int64_t>::min();
+    bool built = false;
+
+    void merge(Scanner& s) {
+        for (size_t i = 0; i < s.title_handle.size(); i++) titles[std::string(s.text(s.title_handle[i]))] += s.title_loans[i];
+        for (size_t i = 0; i < s.author_handle.size(); i++) {
+            AuthorStats& a = authors[std::string(s.text(s.author_handle[i]))];
+            a.loans += s.authors[i].loans;
+            a.closed += s.authors[i].closed;
+            a.overdue += s.authors[i].overdue;
+        }
+        for (auto& d : s.per_day) loans_per_day[d.first] += d.second;
+        for (auto& o : s.open) open.emplace(o.first, std::move(o.second));
+        total_loans += (int64_t)s.rows;
+        closed_loans += s.closed;
+        loan_seconds += s.loan_seconds;
+        last_issue_id = std::max(last_issue_id, s.max_id);
+    }
+
+    // Loans that were out at the last refresh and have since come back
+    size_t settle_open(const ConnectionPool::Lease& conn, const std::vector<std::string>& tables) {
+        size_t settled = 0;
+        for (auto it = open.begin(); it != open.end();) {
+            int64_t ret = 0;
+            uint8_t code = 0;
+            for (const std::string& table : tables) {
+                std::string sql = "SELECT return_datetime, status FROM " + table + " WHERE issue_id = ?;";
+                StmtGuard st = conn.prepared(sql.c_str());
+                if (!st) continue;
+                sqlite3_bind_int64(st.get(), 1, it->first);
+                if (sqlite3_step(st.get()) == SQLITE_ROW) {
+                    ret = sqlite3_column_int64(st.get(), 0);
+                    code = Scanner::status_code(sqlite3_column_text(st.get(), 1));
+                    break;
+                }
+            }
+            if (code == 0) {
+                ++it;
+                continue;
+            }
+            AuthorStats& a = authors[it->second.author];
+            a.closed++;
+            a.overdue += code == 2;
+            closed_loans++;
+            loan_seconds += std::max<int64_t>(0, ret - it->second.issued);
+            it = open.erase(it);
+            settled++;
+        }
+        return settled;
+    }
+
+public:
+    bool empty() const {
+        return !built;
+    }
+
+    void clear() {
+        *this = CirculationSummary();
+    }
+
+    // Bring the summary up to date. conns must hold at least one connection;
+    // one worker runs per connection. tables lists the history partitions.
+    bool refresh(std::vector<ConnectionPool::Lease>& conns, const std::vector<std::string>& tables, RefreshStats& stats) {
+        stats = RefreshStats();
+        stats.full = !built;
+        stats.threads = conns.size();
+        if (conns.empty()) return false;
+        stats.closed = settle_open(conns[0], tables);
+
+        // Split each partition's unseen id range into about 4 pieces per worker
+        std::vector<Range> ranges;
+        for (const std::string& table : tables) {
+            std::string sql = "SELECT MIN(issue_id), MAX(issue_id) FROM " + table + " WHERE issue_id > ?;";
+            StmtGuard st = conns[0].prepared(sql.c_str());
+            if (!st) return false;
+            sqlite3_bind_int64(st.get(), 1, last_issue_id);
+            if (sqlite3_step(st.get()) != SQLITE_ROW || sqlite3_column_type(st.get(), 0) == SQLITE_NULL) continue;
+            int64_t lo = sqlite3_column_int64(st.get(), 0) - 1, hi = sqlite3_column_int64(st.get(), 1);
+            int64_t pieces = (int64_t)conns.size() * 4;
+            int64_t step = std::max<int64_t>(1, (hi - lo + pieces - 1) / pieces);
+            for (int64_t a = lo; a < hi; a += step) ranges.push_back({&table, a, std::min(hi, a + step)});
+        }
+
+        std::vector<Scanner> scanners(conns.size());
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        auto work = [&](size_t w) {
+            size_t r;
+            while ((r = next.fetch_add(1)) < ranges.size()) {
+                if (!scanners[w].scan(conns[w], *ranges[r].table, ranges[r].lo, ranges[r].hi)) failed = true;
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t w = 1; w < conns.size(); w++) pool.emplace_back(work, w);
+        work(0);
+        for (auto& t : pool) t.join();
+        if (failed) return false;
+
+        for (auto& s : scanners) {
+            stats.rows += s.rows;
+            merge(s);
+        }
+        built = true;
+        return true;
+    }
+
+    // ---- Reports ----
+    int64_t loans() const {
+        return total_loans;
+    }
+    int64_t returned() const {
+        return closed_loans;
+    }
+    size_t still_out() const {
+        return open.size();
+    }
+    double average_loan_days() const {
+        return closed_loans > 0 ? (double)loan_seconds / closed_loans / 86400.0 : 0.0;
+    }
+
+    // The last `days` days that had loans, oldest first: (UTC day number, loans)
+    std::vector<std::pair<int64_t, int64_t>> daily(size_t days) const {
+        std::vector<std::pair<int64_t, int64_t>> out;
+        for (auto it = loans_per_day.rbegin(); it != loans_per_day.rend() && out.size() < days; ++it) out.push_back(*it);
+        std::reverse(out.begin(), out.end());
+        return out;
+    }
+
+    // Most borrowed titles: (title, loans)
+    std::vector<std::pair<std::string, int64_t>> top_titles(size_t k) const {
+        std::vector<std::pair<std::string, int64_t>> out(titles.begin(), titles.end());
+        auto by_loans = [](const std::pair<std::string, int64_t>& a, const std::pair<std::string, int64_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        };
+        if (out.size() > k) {
+            std::partial_sort(out.begin(), out.begin() + (long)k, out.end(), by_loans);
+            out.resize(k);
+        } else {
+            std::sort(out.begin(), out.end(), by_loans);
+        }
+        return out;
+    }
+
+    // Authors with at least min_returns returned loans, highest overdue rate first
+    std::vector<std::pair<std::string, AuthorStats>> overdue_by_author(size_t k, int64_t min_returns) const {
+        std::vector<std::pair<std::string, AuthorStats>> out;
+        for (auto& a : authors) {
+            if (a.second.closed >= std::max<int64_t>(1, min_returns)) out.push_back(a);
+        }
+        auto by_rate = [](const std::pair<std::string, AuthorStats>& a, const std::pair<std::string, AuthorStats>& b) {
+            // a.overdue / a.closed vs b.overdue / b.closed
+            int64_t l = a.second.overdue * b.second.closed, r = b.second.overdue * a.second.closed;
+            if (l != r) return l > r;
+            if (a.second.closed != b.second.closed) return a.second.closed > b.second.closed;
+            return a.first < b.first;
+        };
+        size_t n = std::min(k, out.size());
+        std::partial_sort(out.begin(), out.begin() + (long)n, out.end(), by_rate);
+        out.resize(n);
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "sqlite3.h"
+#include "statement_cache.h"
+
+// ----------------------
+// ConnectionPool: a fixed set of read-only connections to one database,
+// each with its own statement cache. A Lease hands one connection to one
+// thread at a time and returns it when the Lease goes out of scope.
+// With the database in WAL mode, pooled readers neither block nor are
+// blocked by the single writer connection.
+// ----------------------
+class ConnectionPool {
+private:
+    struct Conn {
+        sqlite3* db = nullptr;
+        StatementCache stmts;
+        bool busy = false;
+    };
+
+    std::vector<std::unique_ptr<Conn>> conns;
+    std::mutex m;
+    std::condition_variable freed;
+
+    void release(Conn* c) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            c->busy = false;
+        }
+        freed.notify_one();
+    }
+
+    Conn* take_free() {
+        for (auto& c : conns) {
+            if (!c->busy) {
+                c->busy = true;
+                return c.get();
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    class Lease {
+    private:
+        ConnectionPool* pool = nullptr;   // null for an unpooled (borrowed) connection
+        Conn* conn = nullptr;
+        sqlite3* handle = nullptr;
+        StatementCache* cache = nullptr;
+
+        friend class ConnectionPool;
+        Lease(ConnectionPool* p, Conn* c) : pool(p), conn(c), handle(c->db), cache(&c->stmts) {
+
+        }
+
+    public:
+        Lease() = default;
+        // Borrow a connection the caller owns; nothing is returned on release
+        Lease(sqlite3* db, StatementCache* stmts) : handle(db), cache(stmts) {
+
+        }
+        Lease(Lease&& o) noexcept : pool(o.pool), conn(o.conn), handle(o.handle), cache(o.cache) {
+            o.pool = nullptr;
+            o.conn = nullptr;
+            o.handle = nullptr;
+            o.cache = nullptr;
+        }
+        Lease& operator=(Lease&& o) noexcept {
+            if (this != &o) {
+                if (pool) pool->release(conn);
+                pool = o.pool; conn = o.conn; handle = o.handle; cache = o.cache;
+                o.pool = nullptr; o.conn = nullptr; o.handle = nullptr; o.cache = nullptr;
+            }
+            return *this;
+        }
+        ~Lease() {
+            if (pool) pool->release(conn);
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        sqlite3* db() const {
+            return handle;
+        }
+        explicit operator bool() const {
+            return handle != nullptr;
+        }
+        // Cached statement on this connection; keep the guard inside the Lease's scope
+        StmtGuard prepared(const char* sql) const {
+            return StmtGuard(cache->get(sql));
+        }
+    };
+
+    ConnectionPool() = default;
+    ~ConnectionPool() {
+        close();
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Open n read-only connections to path; on failure the pool is left empty
+    bool open(const std::string& path, size_t n, int busy_timeout_ms = 5000) {
+        close();
+        for (size_t i = 0; i < n; i++) {
+            auto c = std::make_unique<Conn>();
+            if (sqlite3_open_v2(path.c_str(), &c->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+                sqlite3_close(c->db);
+                close();
+                return false;
+            }
+            sqlite3_busy_timeout(c->db, busy_timeout_ms);
+            c->stmts.attach(c->db);
+            conns.push_back(std::move(c));
+        }
+        return true;
+    }
+
+    // Run fn(sqlite3*) on every pooled connection, e.g. to install hooks
+    template <class Fn>
+    void each_connection(Fn&& fn) {
+        for (auto& c : conns) fn(c->db);
+    }
+
+    // All leases must have been returned
+    void close() {
+        for (auto& c : conns) {
+            c->stmts.clear();
+            sqlite3_close(c->db);
+        }
+        conns.clear();
+    }
+
+    size_t size() const {
+        return conns.size();
+    }
+
+    // Wait for a free connection; an empty pool yields an empty Lease
+    Lease acquire() {
+        if (conns.empty()) return Lease();
+        std::unique_lock<std::mutex> lock(m);
+        Conn* c;
+        freed.wait(lock, [&] { return (c = take_free()) != nullptr; });
+        return Lease(this, c);
+    }
+
+    // A free connection, or an empty Lease if all are in use
+    Lease try_acquire() {
+        std::lock_guard<std::mutex> lock(m);
+        Conn* c = take_free();
+        return c ? Lease(this, c) : Lease();
+    }
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef COPY_REGISTRY_H
+#define COPY_REGISTRY_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// ----------------------
+// CopyRegistry: which numbered copies of each book are out on loan. A
+// book's copies are numbered 1..total. Its entry keeps the highest number
+// lent so far and a stack of lower numbers that have come back, so taking
+// the next free copy and giving one back are both O(1); the copy returned
+// last goes out first. Books with nothing on loan have no entry, and
+// numbering starts again at 1 once every copy is back.
+// ----------------------
+class CopyRegistry {
+private:
+    struct Copies {
+        int highest = 0;          // copies 1..highest have been lent since the entry was made
+        int out = 0;              // of those, on loan now
+        std::vector<int> free;    // returned copies <= highest, next to lend on top
+    };
+    std::unordered_map<int, Copies> books;
+
+public:
+    // Lend the next free copy of book, which has `total` copies; 0 if every
+    // copy is out
+    int take(int book, int total) {
+        Copies& c = books[book];
+        while (!c.free.empty()) {
+            int n = c.free.back();
+            c.free.pop_back();
+            if (n <= total) {
+                c.out++;
+                return n;
+            }
+        }
+        if (c.highest < total) {
+            c.out++;
+            return ++c.highest;
+        }
+        if (c.out == 0) books.erase(book);
+        return 0;
+    }
+
+    // Record copy as on loan (loading existing loans). Cheapest when each
+    // book's copies arrive in ascending order; false if it is already out.
+    bool claim(int book, int copy) {
+        if (copy <= 0) return false;
+        Copies& c = books[book];
+        if (copy > c.highest) {
+            for (int n = copy - 1; n > c.highest; n--) c.free.push_back(n);   // lowest ends on top
+            c.highest = copy;
+        } else {
+            auto it = c.free.begin();
+            while (it != c.free.end() && *it != copy) ++it;
+            if (it == c.free.end()) return false;
+            c.free.erase(it);
+        }
+        c.out++;
+        return true;
+    }
+
+    // A lent copy is back on the shelf
+    void release(int book, int copy) {
+        auto it = books.find(book);
+        if (it == books.end()) return;
+        Copies& c = it->second;
+        if (--c.out <= 0) {
+            books.erase(it);
+            return;
+        }
+        c.free.push_back(copy);
+    }
+
+    // Copies of book on loan now
+    int on_loan(int book) const {
+        auto it = books.find(book);
+        return it == books.end() ? 0 : it->second.out;
+    }
+
+    // Books with at least one copy on loan
+    size_t size() const {
+        return books.size();
+    }
+
+    void clear() {
+        books.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef DEADLINE_QUEUE_H
+#define DEADLINE_QUEUE_H
+
+#include <ctime>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+// ----------------------
+// DeadlineQueue: ids ordered by a deadline (due date, penalty end, ...).
+// schedule/cancel are O(log n); pop_due hands back everything whose
+// deadline has passed in O(log n) per id, so callers react to expiries
+// incrementally instead of rescanning every record.
+// ----------------------
+class DeadlineQueue {
+private:
+    std::set<std::pair<time_t, int>> order;   // (deadline, id)
+    std::unordered_map<int, time_t> deadline;  // id -> its entry in `order`
+
+public:
+    // Add id, or move it if it is already queued
+    void schedule(int id, time_t when) {
+        cancel(id);
+        order.emplace(when, id);
+        deadline[id] = when;
+    }
+
+    void cancel(int id) {
+        auto it = deadline.find(id);
+        if (it == deadline.end()) return;
+        order.erase(std::make_pair(it->second, id));
+        deadline.erase(it);
+    }
+
+    bool contains(int id) const {
+        return deadline.count(id) > 0;
+    }
+
+    size_t size() const {
+        return deadline.size();
+    }
+
+    void clear() {
+        order.clear();
+        deadline.clear();
+    }
+
+    // Remove and report every id with deadline <= now, earliest first
+    template <class Fn>
+    size_t pop_due(time_t now, Fn&& fn) {
+        size_t n = 0;
+        while (!order.empty() && order.begin()->first <= now) {
+            std::pair<time_t, int> e = *order.begin();
+            order.erase(order.begin());
+            deadline.erase(e.second);
+            fn(e.second, e.first);
+            n++;
+        }
+        return n;
+    }
+
+    // Visit queued ids with deadline < until, earliest first, without removing them
+    template <class Fn>
+    void for_each_before(time_t until, Fn&& fn) const {
+        for (auto it = order.begin(); it != order.end() && it->first < until; ++it) {
+            fn(it->second, it->first);
+        }
+    }
+
+    // Visit every queued id in deadline order
+    template <class Fn>
+    void for_each(Fn&& fn) const {
+        for (auto& e : order) fn(e.second, e.first);
+    }
+};
+
+#endif
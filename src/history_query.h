@@ -0,0 +1,173 @@
+#ifndef HISTORY_QUERY_H
+#define HISTORY_QUERY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+#include "connection_pool.h"
+#include "sqlite3.h"
+
+// ----------------------
+// Paged history queries.
+// Circulation history lives in the hot `history` table plus yearly archive
+// partitions `history_YYYY` (by UTC issue year) holding closed loans moved
+// out of it. Every partition carries the same indexes. Pages are fetched by
+// keyset, newest loan first: each page asks every partition that can hold
+// older rows for its next `limit` rows below the cursor's (issue time,
+// issue id) and merges them. A page therefore costs one index seek per
+// partition however deep the reader has paged, and a cursor stays valid
+// while rows are archived, since archiving never changes a row's key.
+// ----------------------
+struct HistoryRow {
+    int issue_id = 0;
+    int book_id = 0;
+    int user_id = 0;
+    std::string title;
+    std::string author;
+    int64_t issued = 0;
+    int64_t returned = 0;
+    std::string status;
+};
+
+struct HistoryQuery {
+    enum By { ALL, USER, BOOK };
+    By by = ALL;
+    int id = 0;                                            // user or book id
+    int64_t from = 0;                                      // issued at or after
+    int64_t to = std::numeric_limits<int64_t>::max();      // issued before
+};
+
+// Position after the last row returned
+struct HistoryCursor {
+    bool started = false;
+    bool done = false;
+    int64_t before_time = 0;
+    int64_t before_id = 0;
+
+    // "time:id", "" before the first page, "-" once exhausted
+    std::string encode() const {
+        if (done) return "-";
+        if (!started) return "";
+        return std::to_string(before_time) + ":" + std::to_string(before_id);
+    }
+
+    static bool decode(const std::string& s, HistoryCursor& out) {
+        out = HistoryCursor();
+        if (s.empty()) return true;
+        if (s == "-") {
+            out.done = true;
+            return true;
+        }
+        size_t colon = s.find(':');
+        if (colon == std::string::npos) return false;
+        char* end = nullptr;
+        out.before_time = std::strtoll(s.c_str(), &end, 10);
+        if (end != s.c_str() + colon) return false;
+        out.before_id = std::strtoll(s.c_str() + colon + 1, &end, 10);
+        out.started = true;
+        return *end == '\0' && colon > 0;
+    }
+};
+
+class HistoryPager {
+private:
+    static std::string text(sqlite3_stmt* stmt, int col) {
+        const unsigned char* t = sqlite3_column_text(stmt, col);
+        return t ? std::string((const char*)t, (size_t)sqlite3_column_bytes(stmt, col)) : std::string();
+    }
+
+    static std::string page_sql(const std::string& table, HistoryQuery::By by) {
+        std::string sql = "SELECT issue_id, book_id, user_id, title, author, issue_datetime, return_datetime, status FROM " + table + " WHERE ";
+        if (by == HistoryQuery::USER) sql += "user_id = ?5 AND ";
+        if (by == HistoryQuery::BOOK) sql += "book_id = ?5 AND ";
+        return sql + "issue_datetime >= ?1 AND (issue_datetime, issue_id) < (?2, ?3) "
+                     "ORDER BY issue_datetime DESC, issue_id DESC LIMIT ?4;";
+    }
+
+    // Seconds since the epoch at the start of UTC year y
+    static int64_t year_start(int64_t y) {
+        y -= 1;   // days before Jan 1 of y, proleptic Gregorian
+        int64_t days = y * 365 + y / 4 - y / 100 + y / 400 - 719162;
+        return days * 86400;
+    }
+
+public:
+    // "history", or "history_YYYY" for an archive partition
+    static bool is_partition(const std::string& name) {
+        if (name == "history") return true;
+        if (name.size() != 12 || name.compare(0, 8, "history_") != 0) return false;
+        for (size_t i = 8; i < 12; i++) {
+            if (name[i] < '0' || name[i] > '9') return false;
+        }
+        return true;
+    }
+
+    // Indexes every partition carries
+    static std::string index_sql(const std::string& table) {
+        return "CREATE INDEX IF NOT EXISTS idx_" + table + "_user ON " + table + "(user_id, issue_datetime);"
+               "CREATE INDEX IF NOT EXISTS idx_" + table + "_book ON " + table + "(book_id, issue_datetime);"
+               "CREATE INDEX IF NOT EXISTS idx_" + table + "_time ON " + table + "(issue_datetime);";
+    }
+
+    // Append the next page of up to limit rows to out and advance cur.
+    // tables lists the partitions. Returns false on a SQL error.
+    static bool fetch(const ConnectionPool::Lease& conn, const std::vector<std::string>& tables, const HistoryQuery& q,
+                      HistoryCursor& cur, size_t limit, std::vector<HistoryRow>& out) {
+        if (cur.done || limit == 0) return true;
+        if (!cur.started) {
+            cur.started = true;
+            cur.before_time = q.to;
+            cur.before_id = std::numeric_limits<int64_t>::min();
+        }
+
+        std::vector<HistoryRow> page;
+        for (const std::string& table : tables) {
+            if (table != "history") {
+                // An archive only holds its own year
+                int64_t year = std::atoll(table.c_str() + 8);
+                if (year_start(year) > cur.before_time || year_start(year + 1) <= q.from) continue;
+            }
+            StmtGuard st = conn.prepared(page_sql(table, q.by).c_str());
+            if (!st) return false;
+            sqlite3_stmt* stmt = st.get();
+            sqlite3_bind_int64(stmt, 1, q.from);
+            sqlite3_bind_int64(stmt, 2, cur.before_time);
+            sqlite3_bind_int64(stmt, 3, cur.before_id);
+            sqlite3_bind_int64(stmt, 4, (sqlite3_int64)limit);
+            if (q.by != HistoryQuery::ALL) sqlite3_bind_int(stmt, 5, q.id);
+            int rc;
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                HistoryRow r;
+                r.issue_id = sqlite3_column_int(stmt, 0);
+                r.book_id = sqlite3_column_int(stmt, 1);
+                r.user_id = sqlite3_column_int(stmt, 2);
+                r.title = text(stmt, 3);
+                r.author = text(stmt, 4);
+                r.issued = sqlite3_column_int64(stmt, 5);
+                r.returned = sqlite3_column_int64(stmt, 6);
+                r.status = text(stmt, 7);
+                page.push_back(std::move(r));
+            }
+            if (rc != SQLITE_DONE) return false;
+        }
+
+        // Fewer rows than asked for across all partitions: nothing is left
+        cur.done = page.size() < limit;
+        std::sort(page.begin(), page.end(), [](const HistoryRow& a, const HistoryRow& b) {
+            return a.issued != b.issued ? a.issued > b.issued : a.issue_id > b.issue_id;
+        });
+        if (page.size() > limit) page.resize(limit);
+        if (!page.empty()) {
+            cur.before_time = page.back().issued;
+            cur.before_id = page.back().issue_id;
+        }
+        for (auto& r : page) out.push_back(std::move(r));
+        return true;
+    }
+};
+
+#endif
@@ -1,16 +1,45 @@
-//g++ lib_management_sys_sqlite3.cpp -o lib_management_sys_sqlite3 -L. -l sqlite3
+//g++ -std=c++17 -O2 lib_management_sys_sqlite3.cpp -o lib_management_sys_sqlite3 -L. -l sqlite3 -pthread
 // ./y
 
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <sstream>
+#include <fstream>
 #include <iomanip>
 #include <limits>
 #include <ctime>        // for time_t, localtime, time
 #include "sqlite3.h"
 #include <functional>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cctype>
+#include <mutex>
+#include <shared_mutex>
+#include <csignal>
+#include <deque>
+#include <algorithm>
+#include <future>
+#include "statement_cache.h"
+#include "deadline_queue.h"
+#include "search_index.h"
+#include "lru_cache.h"
+#include "catalog_store.h"
+#include "book_import.h"
+#include "snapshot.h"
+#include "connection_pool.h"
+#include "line_server.h"
+#include "load_generator.h"
+#include "history_query.h"
+#include "circulation_stats.h"
+#include "table_writer.h"
+#include "metrics.h"
+#include "write_behind.h"
+#include "op_journal.h"
+#include "copy_registry.h"
 
 using namespace std;
 
@@ -30,8 +59,9 @@ struct Printable {
 class Entity : public Printable {
 protected:
     int id;
+    bool dirty;     // changed in memory since the last save_all()
 public:
-    Entity(int idarg = 0) : id(idarg) {
+    Entity(int idarg = 0) : id(idarg), dirty(false) {
 
     }
     int getID() const { 
@@ -40,6 +70,15 @@ public:
     void setID(int v) {
          id = v; 
     }
+    bool isDirty() const {
+        return dirty;
+    }
+    void markDirty() {
+        dirty = true;
+    }
+    void clearDirty() {
+        dirty = false;
+    }
     // Note: Printable::info remains pure virtual; concrete classes override it.
 };
 
@@ -52,14 +91,13 @@ struct Book : public Entity {
     string author;
     int totalCopies;
     int availableCopies;
-    double avg_rating;
-    int total_ratings;
+    RatingTally ratings;
 
-    Book() : Entity(0), title(""), author(""), totalCopies(0), availableCopies(0), avg_rating(0.0), total_ratings(0) {
+    Book() : Entity(0), title(""), author(""), totalCopies(0), availableCopies(0) {
 
     }
-    Book(int id_, string t, string a, int tot, int avail, double rating = 0.0, int ratings = 0) 
-        : Entity(id_), title(t), author(a), totalCopies(tot), availableCopies(avail), avg_rating(rating), total_ratings(ratings) {
+    Book(int id_, string t, string a, int tot, int avail, const RatingTally& r = RatingTally())
+        : Entity(id_), title(std::move(t)), author(std::move(a)), totalCopies(tot), availableCopies(avail), ratings(r) {
 
     }
 
@@ -69,13 +107,10 @@ struct Book : public Entity {
     }
 
     string info() const override {
-        std::ostringstream ss;
-        ss << "ID: " << book_id() << " | Title: " << title 
-           << " | Author: " << author 
-           << " | Total: " << totalCopies 
-           << " | Available: " << availableCopies
-           << " | Rating: " << fixed << setprecision(1) << avg_rating;
-        return ss.str();
+        char avg[32];
+        snprintf(avg, sizeof(avg), "%.1f", ratings.average());
+        return "ID: " + to_string(book_id()) + " | Title: " + title + " | Author: " + author
+             + " | Total: " + to_string(totalCopies) + " | Available: " + to_string(availableCopies) + " | Rating: " + avg;
     }
 };
 
@@ -90,7 +125,7 @@ struct User : public Entity {
     User() : Entity(0), name(""), isDefaulter(false), penaltyEnd(0) {
 
     }
-    User(int id_, string n) : Entity(id_), name(n), isDefaulter(false), penaltyEnd(0) {
+    User(int id_, string n) : Entity(id_), name(std::move(n)), isDefaulter(false), penaltyEnd(0) {
 
     }
 
@@ -99,17 +134,19 @@ struct User : public Entity {
     }
 
     string info() const override {
-        std::ostringstream ss;
-        ss << "ID: " << user_id() << " | Name: " << name;
+        string out = "ID: " + to_string(user_id()) + " | Name: " + name;
         if (isDefaulter && penaltyEnd > 0) {
             char buf[64] = {0};
-            struct tm* tmv = localtime(&penaltyEnd);
-            if (tmv) {
-                strftime(buf, sizeof(buf), " | Defaulter until: %Y-%m-%d", tmv);
-            }
-            ss << buf;
+            struct tm tmv;
+#ifdef _WIN32
+            bool ok = localtime_s(&tmv, &penaltyEnd) == 0;
+#else
+            bool ok = localtime_r(&penaltyEnd, &tmv) != nullptr;
+#endif
+            if (ok) strftime(buf, sizeof(buf), " | Defaulter until: %Y-%m-%d", &tmv);
+            out += buf;
         }
-        return ss.str();
+        return out;
     }
 };
 
@@ -121,12 +158,13 @@ struct IssuedRecord : public Entity {
     int user_id;
     time_t issueDatetime;
     time_t dueDatetime;
+    int copy_no;    // which copy of the book, 1..totalCopies
 
-    IssuedRecord() : Entity(0), book_id(0), user_id(0), issueDatetime(0), dueDatetime(0) {
+    IssuedRecord() : Entity(0), book_id(0), user_id(0), issueDatetime(0), dueDatetime(0), copy_no(0) {
 
     }
-    IssuedRecord(int iid, int bid, int uid, time_t issue, time_t due) 
-        : Entity(iid), book_id(bid), user_id(uid), issueDatetime(issue), dueDatetime(due) {
+    IssuedRecord(int iid, int bid, int uid, time_t issue, time_t due, int copy = 0) 
+        : Entity(iid), book_id(bid), user_id(uid), issueDatetime(issue), dueDatetime(due), copy_no(copy) {
 
     }
 
@@ -135,10 +173,7 @@ struct IssuedRecord : public Entity {
     }
 
     string info() const override {
-        std::ostringstream ss;
-        ss << "Issued ID: " << issue_id() << " | Book ID: " << book_id 
-           << " | User ID: " << user_id;
-        return ss.str();
+        return "Issued ID: " + to_string(issue_id()) + " | Book ID: " + to_string(book_id) + " | User ID: " + to_string(user_id);
     }
 };
 
@@ -149,52 +184,1011 @@ void printEntity(const Printable& p) {
     cout << p.info() << "\n";
 }
 
+// ----------------------
+// LibraryConfig: runtime options (set from the command line in main)
+// ----------------------
+struct LibraryConfig {
+    string db_file = "library.db";
+    // Storage: WAL lets pooled readers run alongside the writer connection.
+    // synchronous NORMAL in WAL mode stays consistent after a crash; only
+    // the last commits can be lost on power failure.
+    bool wal = true;
+    string synchronous = "NORMAL";   // OFF, NORMAL or FULL
+    int checkpoint_pages = 1000;     // WAL size that triggers an automatic checkpoint
+    int read_connections = 4;        // read-only connections in the pool
+    // Group commit: operations share one write transaction that is committed
+    // after group_commit_ops operations or group_commit_ms milliseconds,
+    // trading a short durability window for one fsync per batch.
+    bool group_commit = false;
+    int group_commit_ops = 64;
+    int group_commit_ms = 50;
+    // Write-behind: issues, returns and penalty ends change memory and are
+    // queued for a background thread that writes them in batched
+    // transactions at least every write_behind_ms. Up to write_behind_max_lag
+    // operations may be unwritten (lost on a crash); callers block when the
+    // queue is full. Resident catalog only; replaces group commit.
+    bool write_behind = false;
+    int write_behind_ms = 100;
+    int write_behind_max_lag = 4096;
+    // Operation log: every issue, return, add and remove is also appended
+    // to oplog_file, fsync'd in batches every oplog_sync_ms (0 = on every
+    // operation). Startup replays whatever the database is missing; the
+    // log is emptied by save_all() and every oplog_checkpoint_ops records.
+    string oplog_file;
+    int oplog_sync_ms = 50;
+    int oplog_checkpoint_ops = 100000;
+    int max_loans = 1;               // books one user may have on loan at once
+    bool print_load_stats = false;   // report rows/sec per table after startup
+    int page_rows = 0;               // book/user listings pause every N rows (0 = no paging)
+    string metrics_file = "metrics.json";   // written on SIGUSR1
+    bool render_bench = false;       // time the listing renderers and exit
+    // Lazy catalog: hold only a bounded LRU of hot Book/User rows (cache_bytes,
+    // split evenly between the two) and fault misses in from SQLite by key.
+    bool lazy_catalog = false;
+    size_t cache_bytes = 64u << 20;
+    // Batch mode: run commands from batch_file ("-" = stdin) instead of the
+    // menus, committing every batch_size commands.
+    string batch_file;
+    int batch_size = 10000;
+    string import_file;   // bulk-load books from this file at startup
+    string export_file;   // write a snapshot here after startup
+    string restore_file;  // rebuild db_file from this snapshot before opening it
+    // Server mode: listen on 127.0.0.1:serve_port with server_workers
+    // request threads (0 = one per core). The load generator instead drives
+    // a server already listening on loadgen_port.
+    int serve_port = 0;
+    int server_workers = 0;
+    int loadgen_port = 0;
+    int loadgen_clients = 8;
+    int loadgen_requests = 10000;
+    int loadgen_hot_books = 0;   // >0: issue/return contention on books 1..N
+    // Diagnostics from the engine (SQL errors, metrics dumps). Library does
+    // no console I/O itself; the console client prints these, an embedding
+    // service can log them, and when unset they are dropped.
+    function<void(const string&)> notify;
+};
+
+// Why an operation did not go through, for callers that branch on the
+// outcome instead of showing the message
+enum class OpStatus {
+    OK,
+    NOT_FOUND,     // no such book, user or loan
+    EXISTS,        // the id is already taken
+    UNAVAILABLE,   // no copy left to lend
+    REFUSED,       // a lending rule says no: defaulter, loan limit reached, copies on loan
+    INVALID,       // bad argument or command usage
+    FAILED         // storage error; nothing was changed
+};
+
+inline const char* status_name(OpStatus s) {
+    static const char* names[] = {"ok", "not_found", "exists", "unavailable", "refused", "invalid", "failed"};
+    return names[(int)s];
+}
+
+// Outcome of one book/user/circulation operation. The console prints the
+// message; batch mode reports it per command. A result built without a
+// status is OK when ok is set and FAILED otherwise.
+struct OpResult {
+    bool ok = false;
+    int id = 0;       // id created by the operation (book or issue), else 0
+    string message;
+    OpStatus status = OpStatus::FAILED;
+
+    OpResult() = default;
+    OpResult(bool ok_, int id_, string message_)
+        : ok(ok_), id(id_), message(std::move(message_)), status(ok_ ? OpStatus::OK : OpStatus::FAILED) {
+
+    }
+    OpResult(bool ok_, int id_, string message_, OpStatus status_)
+        : ok(ok_), id(id_), message(std::move(message_)), status(status_) {
+
+    }
+};
+
 // ----------------------
 // Library class (encapsulation + abstraction)
 // ----------------------
 class Library {
 private:
-    sqlite3* db;
-    unordered_map<int, Book> books;
-    unordered_map<int, User> users;
+    sqlite3* db;            // the single writer connection
+    StatementCache stmts;   // prepared once, reused by every SQL path below
+    ConnectionPool readers; // read-only connections for queries
+
+    // Server-mode locking. Mutations are serialized on writer_mutex (SQLite
+    // has one writer anyway) and do their reads and SQL without blocking
+    // anyone; they hold state_mutex exclusively only while applying a
+    // committed change to the in-memory structures. Read-only requests
+    // share state_mutex, so they run in parallel with each other and with
+    // the SQL part of a write. The console is single-threaded and never
+    // contends on either. Copy counts are the exception: an issue claims its
+    // copy with a CAS under the shared lock (see reserve_copy) before it
+    // queues for the writer.
+    mutex writer_mutex;
+    shared_mutex state_mutex;
+    using StateLock = unique_lock<shared_mutex>;
+    CatalogStore catalog;             // resident mode: every book, column-wise
+    unordered_map<int, User> users;   // resident mode: every user
+    LruCache<Book> book_cache;        // lazy mode: hot books only
+    LruCache<User> user_cache;        // lazy mode: hot users only
+    SearchIndex search_index;         // title/author tokens of every book (resident mode)
+    RatingIndex rating_index;         // rated books in rating and count order (resident mode)
+    vector<string> history_tables;    // "history", then archive partitions newest first
+    CirculationSummary circulation;   // report aggregates, refreshed on demand
+    Metrics metrics;                  // operation latencies and SQLite counters
     unordered_map<int, IssuedRecord> issued;  // key: issue_id
 
-    const string DB_FILE = "library.db";
+    // Secondary indexes over `issued`, maintained by add_issued()/erase_issued()
+    unordered_map<int, vector<int>> issues_by_user;         // user_id -> active issue_ids
+    unordered_map<int, unordered_set<int>> issues_by_book;  // book_id -> active issue_ids
+    CopyRegistry copies;                                    // copy numbers on loan, per book
+
+    // Timers: loans by due date and defaulters by penalty end. refresh_deadlines()
+    // drains whatever has expired since the last call.
+    DeadlineQueue due_queue;          // issue_id -> dueDatetime, loans not yet overdue
+    DeadlineQueue penalty_queue;      // user_id -> penaltyEnd, users still flagged defaulter
+    unordered_set<int> overdue_issues;  // loans past their due date
+    vector<int> overdue_notices;        // loans that became overdue since the last notice run
+
+    // Dirty tracking: ids changed or deleted since the last save_all(),
+    // so a save only touches those rows instead of rewriting every table.
+    vector<int> dirty_books, dirty_users, dirty_issued;
+    vector<int> deleted_books, deleted_users, deleted_issued;
+
+    LibraryConfig config;
     const string ADMIN_PASS = "admin123";
+    const size_t SEARCH_LIMIT = 20;   // results shown per search
+
+    // Group-commit state: the shared transaction and what it holds so far.
+    // group_records keeps each operation's log record until the group
+    // commits, so a group SQLite rolled back can be written again.
+    bool group_open;
+    int group_ops;
+    chrono::steady_clock::time_point group_started;
+    vector<string> group_records;
+    static const int GROUP_COMMIT_ATTEMPTS = 3;
+    static const int GROUP_RETRY_MS = 100;
+
+    // One circulation change as written to the tables: directly by
+    // issue_book/return_book/refresh_deadlines, or later by the write-behind
+    // thread
+    struct LoanWrite {
+        enum Kind { ISSUE, RETURN, END_PENALTIES };
+        Kind kind = ISSUE;
+        int issue_id = 0;    // ISSUE: 0 = assigned by the table
+        int book_id = 0;     // RETURN: 0 when the book no longer exists
+        int user_id = 0;
+        int64_t at = 0;      // issue, return or penalty-check time
+        int64_t until = 0;   // ISSUE: due date; RETURN: penalty end, 0 if on time
+        int rating = 0;      // RETURN: 1-5, 0 = not rated
+        int copy_no = 0;     // ISSUE: copy lent, 0 = the lowest free one in the table
+        uint64_t seq = 0;    // operation-log record, 0 if not logged
+    };
+
+    // Write-behind state: the queue, its own writer connection (used only by
+    // the queue's thread) and the next issue id, handed out in memory since
+    // the issued row is inserted later
+    sqlite3* wb_db;
+    StatementCache wb_stmts;
+    WriteBehind<LoanWrite> write_behind;
+    int next_issue_id;
+
+    // Issues the queue could not write because the table had no copy left
+    // (the database was changed underneath us). The owner thread takes
+    // them back out of memory (cancel_dropped_issues); a return already
+    // queued for one is skipped, as the loan never reached the tables.
+    mutex dropped_mutex;
+    unordered_set<int> dropped_issues;
+
+    // Operation log (op_journal.h). Records are a kind, then its fields:
+    // loans carry a LoanWrite, book/user changes an id, a count and two
+    // strings. meta.oplog_seq holds the last record the tables contain.
+    enum LogKind : uint8_t { LOG_ISSUE = 1, LOG_RETURN, LOG_ADD_BOOK, LOG_REMOVE_BOOK, LOG_ADD_USER, LOG_REMOVE_USER };
+    OpJournal oplog;
+    bool oplog_failing = false;
+
+    void notify(const string& msg) const {
+        if (config.notify) config.notify(msg);
+    }
 
     // SQLite helper functions (encapsulated)
     bool exec_sql(const char* sql) {
         char* errMsg = nullptr;
         int rc = sqlite3_exec(db, sql, nullptr, nullptr, &errMsg);
         if (rc != SQLITE_OK) {
-            cout << "SQL error: " << (errMsg ? errMsg : "(unknown)") << endl;
+            notify(string("SQL error: ") + (errMsg ? errMsg : "(unknown)"));
             if (errMsg) sqlite3_free(errMsg);
             return false;
         }
         return true;
     }
 
+    // Cached, reset-on-scope-exit statement for sql
+    StmtGuard prepared(const char* sql) {
+        return StmtGuard(stmts.get(sql));
+    }
+
+    // Connection for a read-only query: a pooled reader, or the writer itself
+    // while it holds uncommitted group-commit work the query must see. The
+    // writer connection and its statement cache are not thread safe, so
+    // only the thread that owns the writer may call this: the console,
+    // batch mode, or a server thread holding writer_mutex.
+    ConnectionPool::Lease read_conn() {
+        if (group_open || readers.size() == 0) return ConnectionPool::Lease(db, &stmts);
+        return readers.acquire();
+    }
+
+    // Connection for a query that holds only the shared state lock: always
+    // a pooled reader, so it sees committed rows only. Empty when there is
+    // no pool.
+    ConnectionPool::Lease pooled_read_conn() {
+        return readers.acquire();
+    }
+
+    // Step a cached write statement, reporting failures like exec_sql does
+    bool run_stmt(StmtGuard& st, sqlite3* conn) {
+        if (!st) {
+            notify(string("SQL error: ") + sqlite3_errmsg(conn));
+            return false;
+        }
+        if (!st.run()) {
+            notify(string("SQL error: ") + sqlite3_errmsg(conn));
+            return false;
+        }
+        return true;
+    }
+
+    bool run_stmt(StmtGuard& st) {
+        return run_stmt(st, db);
+    }
+
+    // The writer connection with its statement cache, for the helpers below
+    // that the write-behind thread also runs on its own connection
+    ConnectionPool::Lease writer_conn() {
+        return ConnectionPool::Lease(db, &stmts);
+    }
+
+    bool insert_user_row(int id, const string& name) {
+        StmtGuard st = prepared("INSERT INTO users (user_id, name) VALUES (?, ?);");
+        if (st) {
+            sqlite3_bind_int(st.get(), 1, id);
+            sqlite3_bind_text(st.get(), 2, name.c_str(), -1, SQLITE_TRANSIENT);
+        }
+        return run_stmt(st);
+    }
+
+    // Copy counts are only ever changed relative to the stored value, and the
+    // decrement is conditional, so the table itself can never go below zero
+    // or above total_copies whatever the in-memory state says.
+    // 1 = copy taken, 0 = none left, -1 = error
+    int take_copy_row(ConnectionPool::Lease& conn, int book_id) {
+        StmtGuard st = conn.prepared("UPDATE books SET available_copies = available_copies - 1 WHERE book_id = ? AND available_copies > 0;");
+        if (st) sqlite3_bind_int(st.get(), 1, book_id);
+        if (!run_stmt(st, conn.db())) return -1;
+        return sqlite3_changes(conn.db()) == 1 ? 1 : 0;
+    }
+
+    bool give_back_copy_row(ConnectionPool::Lease& conn, int book_id) {
+        StmtGuard st = conn.prepared("UPDATE books SET available_copies = MIN(available_copies + 1, total_copies) WHERE book_id = ?;");
+        if (st) sqlite3_bind_int(st.get(), 1, book_id);
+        return run_stmt(st, conn.db());
+    }
+
+    // Count one more rating of `stars` (1-5): the exact totals are bumped in
+    // place and the stored average is recomputed from them
+    bool add_rating_row(ConnectionPool::Lease& conn, int book_id, int stars) {
+        StmtGuard st = conn.prepared("UPDATE books SET total_ratings = total_ratings + 1, rating_sum = rating_sum + ?1, "
+                                "avg_rating = CAST(rating_sum + ?1 AS REAL) / (total_ratings + 1), "
+                                "stars_1 = stars_1 + (?1 = 1), stars_2 = stars_2 + (?1 = 2), stars_3 = stars_3 + (?1 = 3), "
+                                "stars_4 = stars_4 + (?1 = 4), stars_5 = stars_5 + (?1 = 5) WHERE book_id = ?2;");
+        if (st) {
+            sqlite3_bind_int(st.get(), 1, stars);
+            sqlite3_bind_int(st.get(), 2, book_id);
+        }
+        return run_stmt(st, conn.db());
+    }
+
+    // Write one circulation change on conn, inside the caller's transaction
+    // (END_PENALTIES may run on its own). An ISSUE without an issue_id gets
+    // the one the table assigned.
+    // 1 = written, 0 = no copy left to issue, -1 = error
+    int write_loan(ConnectionPool::Lease& conn, LoanWrite& w) {
+        if (w.kind == LoanWrite::ISSUE) {
+            int taken = take_copy_row(conn, w.book_id);
+            if (taken != 1) return taken;
+            StmtGuard st_issue = conn.prepared("INSERT INTO issued (issue_id, book_id, user_id, issue_datetime, due_datetime, copy_no) "
+                                               "VALUES (?1, ?2, ?3, ?4, ?5, IFNULL(?6, (SELECT MIN(n) FROM (SELECT 1 AS n UNION ALL "
+                                               "SELECT copy_no + 1 FROM issued WHERE book_id = ?2) WHERE n NOT IN (SELECT copy_no FROM issued WHERE book_id = ?2))));");
+            if (st_issue) {
+                sqlite3_stmt* stmt = st_issue.get();
+                if (w.issue_id) sqlite3_bind_int(stmt, 1, w.issue_id); else sqlite3_bind_null(stmt, 1);
+                sqlite3_bind_int(stmt, 2, w.book_id);
+                sqlite3_bind_int(stmt, 3, w.user_id);
+                sqlite3_bind_int64(stmt, 4, (sqlite3_int64)w.at);
+                sqlite3_bind_int64(stmt, 5, (sqlite3_int64)w.until);
+                if (w.copy_no) sqlite3_bind_int(stmt, 6, w.copy_no); else sqlite3_bind_null(stmt, 6);
+            }
+            if (!run_stmt(st_issue, conn.db())) return -1;
+            if (!w.issue_id) w.issue_id = (int)sqlite3_last_insert_rowid(conn.db());
+
+            StmtGuard st_history = conn.prepared("INSERT INTO history (issue_id, book_id, user_id, title, author, issue_datetime, return_datetime, status) "
+                                                 "SELECT ?1, ?2, ?3, title, author, ?4, 0, 'issued' FROM books WHERE book_id = ?2;");
+            if (st_history) {
+                sqlite3_stmt* stmt = st_history.get();
+                sqlite3_bind_int(stmt, 1, w.issue_id);
+                sqlite3_bind_int(stmt, 2, w.book_id);
+                sqlite3_bind_int(stmt, 3, w.user_id);
+                sqlite3_bind_int64(stmt, 4, (sqlite3_int64)w.at);
+            }
+            return run_stmt(st_history, conn.db()) ? 1 : -1;
+        }
+
+        if (w.kind == LoanWrite::END_PENALTIES) {
+            StmtGuard st = conn.prepared("UPDATE users SET is_defaulter = 0 WHERE is_defaulter = 1 AND penalty_end <= ?;");
+            if (st) sqlite3_bind_int64(st.get(), 1, (sqlite3_int64)w.at);
+            return run_stmt(st, conn.db()) ? 1 : -1;
+        }
+
+        if (w.book_id && !(give_back_copy_row(conn, w.book_id) && (w.rating == 0 || add_rating_row(conn, w.book_id, w.rating)))) return -1;
+
+        StmtGuard st_delete = conn.prepared("DELETE FROM issued WHERE issue_id = ?;");
+        if (st_delete) sqlite3_bind_int(st_delete.get(), 1, w.issue_id);
+        if (!run_stmt(st_delete, conn.db())) return -1;
+
+        if (w.until) {
+            StmtGuard st_user = conn.prepared("UPDATE users SET is_defaulter = 1, penalty_end = ? WHERE user_id = ?;");
+            if (st_user) {
+                sqlite3_bind_int64(st_user.get(), 1, (sqlite3_int64)w.until);
+                sqlite3_bind_int(st_user.get(), 2, w.user_id);
+            }
+            if (!run_stmt(st_user, conn.db())) return -1;
+        }
+
+        StmtGuard st_history = conn.prepared("UPDATE history SET return_datetime = ?, status = ? WHERE issue_id = ?;");
+        if (st_history) {
+            sqlite3_bind_int64(st_history.get(), 1, (sqlite3_int64)w.at);
+            sqlite3_bind_text(st_history.get(), 2, w.until ? "defaulter" : "returned", -1, SQLITE_STATIC);
+            sqlite3_bind_int(st_history.get(), 3, w.issue_id);
+        }
+        return run_stmt(st_history, conn.db()) ? 1 : -1;
+    }
+
+    // Write-behind thread: one batch of queued changes in one transaction.
+    // A failed batch is rolled back and retried whole by the queue. An
+    // issue with no copy left in the table is dropped, and counts as
+    // logged only because the owner thread then cancels it in memory too.
+    bool write_loans(vector<LoanWrite>& jobs) {
+        ConnectionPool::Lease conn(wb_db, &wb_stmts);
+        StmtGuard begin = conn.prepared("BEGIN IMMEDIATE;");
+        if (!run_stmt(begin, wb_db)) return false;
+        bool ok = true;
+        uint64_t logged = 0;
+        vector<int> dropped, skipped;   // published only once the batch commits
+        for (LoanWrite& w : jobs) {
+            logged = max(logged, w.seq);
+            if (w.kind == LoanWrite::RETURN && (find(dropped.begin(), dropped.end(), w.issue_id) != dropped.end()
+                                                || dropped_issue(w.issue_id))) {
+                skipped.push_back(w.issue_id);
+                continue;
+            }
+            int written = write_loan(conn, w);
+            if (written < 0) {
+                ok = false;
+                break;
+            }
+            if (written == 0) dropped.push_back(w.issue_id);
+        }
+        if (ok && logged) ok = mark_logged(conn, logged);
+        if (ok) {
+            Metrics::Timer timer(metrics, Metrics::COMMIT);
+            StmtGuard commit = conn.prepared("COMMIT;");
+            ok = run_stmt(commit, wb_db);
+        }
+        if (!ok) {
+            StmtGuard rollback = conn.prepared("ROLLBACK;");
+            rollback.run();
+            return false;
+        }
+        if (!dropped.empty() || !skipped.empty()) {
+            lock_guard<mutex> lock(dropped_mutex);
+            for (int id : dropped) dropped_issues.insert(id);
+            for (int id : skipped) dropped_issues.erase(id);
+        }
+        for (int id : dropped) {
+            notify("Write-behind: no copy left in the database for issue " + to_string(id) + "; the loan was not written and is cancelled.");
+        }
+        return true;
+    }
+
+    bool dropped_issue(int issue_id) {
+        lock_guard<mutex> lock(dropped_mutex);
+        return dropped_issues.count(issue_id) > 0;
+    }
+
+    // Owner thread, holding no state lock: take the loans the queue dropped
+    // out of memory, giving back the copy each one claimed. A loan already
+    // returned in memory stays listed until its queued return is skipped.
+    void cancel_dropped_issues() {
+        vector<int> ids;
+        {
+            lock_guard<mutex> lock(dropped_mutex);
+            if (dropped_issues.empty()) return;
+            ids.assign(dropped_issues.begin(), dropped_issues.end());
+        }
+        StateLock lock(state_mutex);
+        for (int id : ids) {
+            auto it = issued.find(id);
+            if (it == issued.end()) continue;
+            IssuedRecord rec = it->second;
+            Book b;
+            if (get_book(rec.book_id, b)) {
+                b.availableCopies = min(b.availableCopies + 1, b.totalCopies);
+                put_book(b);
+            }
+            erase_issued(id);
+            {
+                lock_guard<mutex> dl(dropped_mutex);
+                dropped_issues.erase(id);
+            }
+            notify("Issue " + to_string(id) + " of book " + to_string(rec.book_id) + " to user " + to_string(rec.user_id)
+                   + " was cancelled: the database had no copy left for it.");
+        }
+    }
+
+    bool exec_cached(const char* sql) {
+        StmtGuard st = prepared(sql);
+        return run_stmt(st);
+    }
+
+    // Each issue/return runs between begin_op() and commit_op()/rollback_op()
+    // so all of its statements land atomically. In group-commit mode the
+    // operation is a savepoint inside the shared transaction instead.
+    bool begin_op() {
+        write_behind.flush();   // queued changes land before this one
+        // A group that is due, rolled back, or left over from batch mode
+        // commits first; its operations are already acknowledged
+        if (group_pending() && (!config.group_commit || !group_open || group_commit_due())) flush_group_commit();
+        if (!group_open && !group_records.empty()) return false;
+        if (!config.group_commit) return !group_open && exec_cached("BEGIN IMMEDIATE;");
+
+        if (!group_open) {
+            if (!exec_cached("BEGIN IMMEDIATE;")) return false;
+            group_open = true;
+            group_ops = 0;
+            group_started = chrono::steady_clock::now();
+        }
+        return exec_cached("SAVEPOINT op;");
+    }
+
+    // COMMIT, timed: this is where the fsync happens
+    bool commit_transaction() {
+        Metrics::Timer timer(metrics, Metrics::COMMIT);
+        return exec_cached("COMMIT;");
+    }
+
+    // record: the operation's log record; the database's log position is
+    // moved in the same transaction and the record appended once it commits.
+    // A grouped operation is done once its savepoint is released; the group
+    // itself commits from the next begin_op(), tick() or flush.
+    bool commit_op(const string& record) {
+        bool logged = !record.empty() && oplog.is_open();
+        if (logged) {
+            ConnectionPool::Lease conn = writer_conn();
+            if (!mark_logged(conn, oplog.last_seq() + 1)) return false;
+        }
+        bool ok;
+        if (!config.group_commit) {
+            ok = commit_transaction();
+        } else {
+            ok = exec_cached("RELEASE op;");
+            if (ok) {
+                group_ops++;
+                group_records.push_back(record);
+            }
+        }
+        if (ok && logged) log_op(record);
+        return ok;
+    }
+
+    static string log_record(const LoanWrite& w) {
+        string rec(1, (char)(w.kind == LoanWrite::ISSUE ? LOG_ISSUE : LOG_RETURN));
+        OpJournal::put_i64(rec, w.issue_id);
+        OpJournal::put_i64(rec, w.book_id);
+        OpJournal::put_i64(rec, w.user_id);
+        OpJournal::put_i64(rec, w.at);
+        OpJournal::put_i64(rec, w.until);
+        OpJournal::put_i64(rec, w.rating);
+        OpJournal::put_i64(rec, w.copy_no);
+        return rec;
+    }
+
+    static string log_record(LogKind kind, int id, int count = 0, const string& a = string(), const string& b = string()) {
+        string rec(1, (char)kind);
+        OpJournal::put_i64(rec, id);
+        OpJournal::put_i64(rec, count);
+        OpJournal::put_str(rec, a);
+        OpJournal::put_str(rec, b);
+        return rec;
+    }
+
+    bool mark_logged(ConnectionPool::Lease& conn, uint64_t seq) {
+        StmtGuard st = conn.prepared("INSERT INTO meta (key, value) VALUES ('oplog_seq', ?) ON CONFLICT(key) DO UPDATE SET value = excluded.value;");
+        if (st) sqlite3_bind_int64(st.get(), 1, (sqlite3_int64)seq);
+        return run_stmt(st, conn.db());
+    }
+
+    // Append a committed or queued operation to the log; 0 if it could not
+    // be written. A log holding oplog_checkpoint_ops records is emptied first.
+    uint64_t log_op(const string& record) {
+        if (!oplog.is_open()) return 0;
+        if (oplog.records() >= (size_t)max(1, config.oplog_checkpoint_ops)) checkpoint_oplog();
+        uint64_t seq = oplog.append(record);
+        if (!seq && !oplog_failing) notify("Cannot write the operation log " + config.oplog_file + "; changes are only in the database until the next save.");
+        oplog_failing = seq == 0;
+        return seq;
+    }
+
+    // Once pending commits and the write-behind queue are flushed the
+    // tables hold every logged operation, so the log can start over
+    bool checkpoint_oplog() {
+        if (!flush_group_commit()) return false;
+        return !oplog.is_open() || oplog.reset();
+    }
+
+    void rollback_op() {
+        if (!config.group_commit) {
+            exec_cached("ROLLBACK;");
+            return;
+        }
+        if (!sqlite3_get_autocommit(db)) {
+            exec_cached("ROLLBACK TO op;");
+            exec_cached("RELEASE op;");
+        }
+        // Some errors roll back the whole group; the next flush rewrites it
+        group_open = !sqlite3_get_autocommit(db);
+    }
+
+    bool group_pending() const {
+        return group_open || !group_records.empty();
+    }
+
+    bool group_commit_due() const {
+        if (group_ops >= config.group_commit_ops) return true;
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - group_started);
+        return elapsed.count() >= config.group_commit_ms;
+    }
+
     int get_last_insert_rowid() {
         return (int)sqlite3_last_insert_rowid(db);
     }
 
+    // Record an entity as changed; each id is queued once until the next save
+    template <class T>
+    void mark_dirty(T& e, vector<int>& pending) {
+        if (!e.isDirty()) {
+            e.markDirty();
+            pending.push_back(e.getID());
+        }
+    }
+
+    // All inserts into and removals from `issued` go through these two so the
+    // secondary indexes never drift from the primary map. The loan's copy
+    // number is already taken in `copies` (by issue_book or load_issued);
+    // erase_issued gives it back.
+    IssuedRecord& add_issued(const IssuedRecord& r) {
+        IssuedRecord& rec = issued[r.issue_id()] = r;
+        issues_by_user[r.user_id].push_back(r.issue_id());
+        issues_by_book[r.book_id].insert(r.issue_id());
+        due_queue.schedule(r.issue_id(), r.dueDatetime);
+        return rec;
+    }
+
+    void erase_issued(int issue_id) {
+        auto it = issued.find(issue_id);
+        if (it == issued.end()) return;
+        const IssuedRecord& r = it->second;
+        auto u = issues_by_user.find(r.user_id);
+        if (u != issues_by_user.end()) {
+            vector<int>& ids = u->second;
+            ids.erase(remove(ids.begin(), ids.end(), issue_id), ids.end());
+            if (ids.empty()) issues_by_user.erase(u);
+        }
+        auto b = issues_by_book.find(r.book_id);
+        if (b != issues_by_book.end()) {
+            b->second.erase(issue_id);
+            if (b->second.empty()) issues_by_book.erase(b);
+        }
+        if (r.copy_no) copies.release(r.book_id, r.copy_no);
+        due_queue.cancel(issue_id);
+        overdue_issues.erase(issue_id);
+        issued.erase(it);
+    }
+
+    // Active loans of a user: a handful at most, so lookups below walk them
+    size_t loans_held(int userId) const {
+        auto u = issues_by_user.find(userId);
+        return u == issues_by_user.end() ? 0 : u->second.size();
+    }
+
+    // The user's loan due first, or nullptr
+    const IssuedRecord* active_issue_of(int userId) const {
+        auto u = issues_by_user.find(userId);
+        if (u == issues_by_user.end()) return nullptr;
+        const IssuedRecord* first = nullptr;
+        for (int iid : u->second) {
+            auto it = issued.find(iid);
+            if (it != issued.end() && (!first || it->second.dueDatetime < first->dueDatetime)) first = &it->second;
+        }
+        return first;
+    }
+
+    // The user's loan of book_id, or nullptr
+    const IssuedRecord* active_issue_of(int userId, int book_id) const {
+        auto u = issues_by_user.find(userId);
+        if (u == issues_by_user.end()) return nullptr;
+        for (int iid : u->second) {
+            auto it = issued.find(iid);
+            if (it != issued.end() && it->second.book_id == book_id) return &it->second;
+        }
+        return nullptr;
+    }
+
+    // Move loans that passed their due date into overdue_issues and clear
+    // every penalty that has ended, persisting the latter with one UPDATE.
+    void refresh_deadlines(time_t now) {
+        StateLock lock(state_mutex);
+        due_queue.pop_due(now, [&](int issue_id, time_t) {
+            overdue_issues.insert(issue_id);
+            overdue_notices.push_back(issue_id);
+        });
+
+        vector<int> expired;
+        penalty_queue.pop_due(now, [&](int user_id, time_t) { expired.push_back(user_id); });
+        if (expired.empty()) return;
+
+        LoanWrite w;
+        w.kind = LoanWrite::END_PENALTIES;
+        w.at = now;
+        if (write_behind.active()) {
+            write_behind.push(w);
+        } else {
+            ConnectionPool::Lease conn = writer_conn();
+            write_loan(conn, w);
+        }
+        for (int uid : expired) {
+            User* u = resident_user(uid);   // rows not in memory were covered by the UPDATE
+            if (!u) continue;
+            u->isDefaulter = false;
+            mark_user_dirty(*u);
+        }
+    }
+
+    // ----------------------
+    // Book/User storage. Resident mode (default) mirrors every row, books in
+    // the columnar `catalog` and users in `users`; lazy mode keeps a bounded
+    // LRU of hot rows and faults misses in from SQLite. Callers work on
+    // copies and hand changes back with put_*(), because a later fault may
+    // evict a cached entry.
+    // ----------------------
+    bool lazy() const { return config.lazy_catalog; }
+
+    static size_t footprint(const Book& b) {
+        return sizeof(Book) + b.title.capacity() + b.author.capacity() + 64;  // + list/hash node overhead
+    }
+    static size_t footprint(const User& u) {
+        return sizeof(User) + u.name.capacity() + 64;
+    }
+
+    bool fetch_book(int id, Book& out) {
+        StmtGuard st = prepared("SELECT title, author, total_copies, available_copies, "
+                                "total_ratings, rating_sum, stars_1, stars_2, stars_3, stars_4, stars_5 FROM books WHERE book_id = ?;");
+        if (!st) return false;
+        sqlite3_stmt* stmt = st.get();
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) != SQLITE_ROW) return false;
+        out = Book(id, column_string(stmt, 0), column_string(stmt, 1), sqlite3_column_int(stmt, 2),
+                   sqlite3_column_int(stmt, 3), column_tally(stmt, 4));
+        return true;
+    }
+
+    bool fetch_user(int id, User& out) {
+        StmtGuard st = prepared("SELECT name, is_defaulter, penalty_end FROM users WHERE user_id = ?;");
+        if (!st) return false;
+        sqlite3_stmt* stmt = st.get();
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) != SQLITE_ROW) return false;
+        out = User(id, column_string(stmt, 0));
+        out.isDefaulter = sqlite3_column_int(stmt, 1) != 0;
+        out.penaltyEnd = (time_t)sqlite3_column_int64(stmt, 2);
+        return true;
+    }
+
+    // Copy catalog row `slot` into out, reusing out's string buffers
+    void read_slot(uint32_t slot, Book& out) const {
+        out.setID(catalog.ids[slot]);
+        out.title.assign(catalog.title(slot));
+        out.author.assign(catalog.author(slot));
+        out.totalCopies = catalog.total_copies[slot];
+        out.availableCopies = catalog.available_copies[slot];
+        out.ratings = catalog.ratings(slot);
+        if (catalog.dirty[slot]) out.markDirty(); else out.clearDirty();
+    }
+
+    // Lazy mode: cached entry or nullptr, faulting it in from the DB
+    Book* book_entry(int id) {
+        if (Book* b = book_cache.get(id)) return b;
+        Book b;
+        if (!fetch_book(id, b)) return nullptr;
+        size_t size = footprint(b);
+        return &book_cache.put(id, std::move(b), size);
+    }
+
+    User* user_entry(int id) {
+        if (!lazy()) {
+            auto it = users.find(id);
+            return it == users.end() ? nullptr : &it->second;
+        }
+        if (User* u = user_cache.get(id)) return u;
+        User u;
+        if (!fetch_user(id, u)) return nullptr;
+        size_t size = footprint(u);
+        return &user_cache.put(id, std::move(u), size);
+    }
+
+    // Stored entry only if it is already in memory (never faults)
+    User* resident_user(int id) {
+        if (lazy()) return user_cache.peek(id);
+        auto it = users.find(id);
+        return it == users.end() ? nullptr : &it->second;
+    }
+
+    bool has_book(int id) {
+        return lazy() ? book_entry(id) != nullptr : catalog.find(id) != CatalogStore::NPOS;
+    }
+    bool has_user(int id) { return user_entry(id) != nullptr; }
+
+    bool get_book(int id, Book& out) {
+        if (!lazy()) {
+            uint32_t slot = catalog.find(id);
+            if (slot != CatalogStore::NPOS) read_slot(slot, out);
+            return slot != CatalogStore::NPOS;
+        }
+        Book* b = book_entry(id);
+        if (b) out = *b;
+        return b != nullptr;
+    }
+
+    bool get_user(int id, User& out) {
+        User* u = user_entry(id);
+        if (u) out = *u;
+        return u != nullptr;
+    }
+
+    // Store a new or changed entity and mark it dirty. The dirty flag is taken
+    // from the stored entry, not from the (possibly stale) copy.
+    void put_book(Book b) {
+        int id = b.book_id();
+        if (!lazy()) {
+            uint32_t old = catalog.find(id);
+            rating_index.update(id, old != CatalogStore::NPOS ? catalog.ratings(old) : RatingTally(), b.ratings);
+            uint32_t slot = catalog.upsert(id, b.title, b.author, b.totalCopies, b.availableCopies, b.ratings);
+            if (!catalog.dirty[slot]) {
+                catalog.dirty[slot] = 1;
+                dirty_books.push_back(id);
+            }
+            return;
+        }
+        Book* cur = book_cache.peek(id);
+        if (cur && cur->isDirty()) b.markDirty(); else b.clearDirty();
+        size_t size = footprint(b);
+        mark_book_dirty(book_cache.put(id, std::move(b), size));
+    }
+
+    void put_user(User u) {
+        int id = u.user_id();
+        User* cur = resident_user(id);
+        if (cur && cur->isDirty()) u.markDirty(); else u.clearDirty();
+        size_t size = footprint(u);
+        User& slot = lazy() ? user_cache.put(id, std::move(u), size) : (users[id] = std::move(u));
+        mark_user_dirty(slot);
+    }
+
+    void erase_book(int id) {
+        if (lazy()) {
+            book_cache.erase(id);
+        } else {
+            uint32_t slot = catalog.find(id);
+            if (slot != CatalogStore::NPOS) rating_index.erase(id, catalog.ratings(slot));
+            catalog.erase(id);
+        }
+        deleted_books.push_back(id);
+    }
+
+    void erase_user(int id) {
+        if (lazy()) user_cache.erase(id); else users.erase(id);
+        deleted_users.push_back(id);
+    }
+
+    size_t book_count() {
+        if (!lazy()) return catalog.size();
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared("SELECT COUNT(*) FROM books;");
+        return st && sqlite3_step(st.get()) == SQLITE_ROW ? (size_t)sqlite3_column_int64(st.get(), 0) : 0;
+    }
+
+    size_t user_count() {
+        if (!lazy()) return users.size();
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared("SELECT COUNT(*) FROM users;");
+        return st && sqlite3_step(st.get()) == SQLITE_ROW ? (size_t)sqlite3_column_int64(st.get(), 0) : 0;
+    }
+
+    // A visitor may return false to stop the walk early
+    template <class Fn, class T>
+    static bool visit(Fn& fn, const T& v) {
+        if constexpr (is_same_v<decltype(fn(v)), bool>) {
+            return fn(v);
+        } else {
+            fn(v);
+            return true;
+        }
+    }
+
+    // Visit every book. Resident mode decodes catalog rows into one scratch
+    // Book; lazy mode streams rows from the DB (preferring any cached copy)
+    // without pulling them into the cache.
+    template <class Fn>
+    void for_each_book(Fn&& fn) {
+        if (!lazy()) {
+            Book b;
+            for (uint32_t slot = 0; slot < catalog.size(); slot++) {
+                read_slot(slot, b);
+                if (!visit(fn, b)) return;
+            }
+            return;
+        }
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared("SELECT book_id, title, author, total_copies, available_copies, "
+                                     "total_ratings, rating_sum, stars_1, stars_2, stars_3, stars_4, stars_5 FROM books;");
+        if (!st) return;
+        sqlite3_stmt* stmt = st.get();
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int id = sqlite3_column_int(stmt, 0);
+            if (const Book* cached = book_cache.peek(id)) {
+                if (!visit(fn, *cached)) return;
+                continue;
+            }
+            Book b(id, column_string(stmt, 1), column_string(stmt, 2), sqlite3_column_int(stmt, 3),
+                   sqlite3_column_int(stmt, 4), column_tally(stmt, 5));
+            if (!visit(fn, b)) return;
+        }
+    }
+
+    template <class Fn>
+    void for_each_user(Fn&& fn) {
+        if (!lazy()) {
+            for (auto& p : users) {
+                if (!visit(fn, p.second)) return;
+            }
+            return;
+        }
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared("SELECT user_id, name, is_defaulter, penalty_end FROM users;");
+        if (!st) return;
+        sqlite3_stmt* stmt = st.get();
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int id = sqlite3_column_int(stmt, 0);
+            if (const User* cached = user_cache.peek(id)) {
+                if (!visit(fn, *cached)) return;
+                continue;
+            }
+            User u(id, column_string(stmt, 1));
+            u.isDefaulter = sqlite3_column_int(stmt, 2) != 0;
+            u.penaltyEnd = (time_t)sqlite3_column_int64(stmt, 3);
+            if (!visit(fn, u)) return;
+        }
+    }
+
+    void mark_book_dirty(Book& b) { mark_dirty(b, dirty_books); }
+    void mark_user_dirty(User& u) { mark_dirty(u, dirty_users); }
+    void mark_issued_dirty(IssuedRecord& r) { mark_dirty(r, dirty_issued); }
+
 public:
     // Constructor opens DB, initializes schema and loads data
-    Library() : db(nullptr) {
-        if (sqlite3_open(DB_FILE.c_str(), &db) != SQLITE_OK) {
-            cout << "Cannot open database" << endl;
+    Library(const LibraryConfig& cfg = LibraryConfig())
+        : db(nullptr), config(cfg), group_open(false), group_ops(0), wb_db(nullptr), next_issue_id(0) {
+        if (sqlite3_open(config.db_file.c_str(), &db) != SQLITE_OK) {
+            notify("Cannot open database " + config.db_file);
             exit(1);
         }
+        stmts.attach(db);
+        metrics.attach(db);
+        configure_storage();
+        // A dirty row leaving the lazy cache is written back before it is dropped
+        book_cache.set_capacity(config.cache_bytes / 2);
+        user_cache.set_capacity(config.cache_bytes / 2);
+        book_cache.set_evict_handler([this](int, Book& b) { if (b.isDirty()) write_book_row(b); });
+        user_cache.set_evict_handler([this](int, User& u) { if (u.isDirty()) write_user_row(u); });
         init_schema();
+        if (!config.oplog_file.empty()) open_oplog();
+        // Readers open once the file and schema exist; in-memory databases cannot be shared
+        if (config.db_file != ":memory:" && !readers.open(config.db_file, (size_t)max(0, config.read_connections))) {
+            notify("Cannot open read connections; queries will use the main connection.");
+        }
+        readers.each_connection([this](sqlite3* conn) { metrics.attach(conn); });
         load_all_data();
+        if (config.write_behind) start_write_behind();
     }
 
     // Destructor saves and closes DB
     ~Library() {
-        save_all();
+        save_all();   // drains the write-behind queue first and empties the log
+        if (!group_records.empty()) {
+            string lost;
+            for (const string& rec : group_records) lost += "\n  " + describe_record(rec);
+            notify(to_string(group_records.size()) + " acknowledged operations were not written to the database"
+                   + (oplog.is_open() ? " (the operation log keeps them for the next start):" : ":") + lost);
+        }
+        write_behind.stop();
+        oplog.close();
+        wb_stmts.clear();
+        if (wb_db) sqlite3_close(wb_db);
+        readers.close();   // before the writer, so its close can checkpoint the WAL
+        stmts.clear();
         if (db) sqlite3_close(db);
     }
 
+    // Journal mode, durability and checkpoint settings for the writer connection
+    void configure_storage() {
+        sqlite3_busy_timeout(db, 5000);
+        string pragmas = string("PRAGMA journal_mode = ") + (config.wal ? "WAL" : "DELETE") + ";"
+                       + synchronous_pragma()
+                       + " PRAGMA wal_autocheckpoint = " + to_string(max(0, config.checkpoint_pages)) + ";";
+        exec_sql(pragmas.c_str());
+    }
+
+    string synchronous_pragma() const {
+        string sync = config.synchronous;
+        for (char& c : sync) c = (char)toupper((unsigned char)c);
+        return " PRAGMA synchronous = " + sync + ";";
+    }
+
+    // Open the write-behind connection and start its thread. Lazy mode keeps
+    // writing synchronously: it faults rows back in from the tables, which
+    // would miss whatever is still queued.
+    void start_write_behind() {
+        if (lazy() || config.db_file == ":memory:") {
+            notify("Write-behind needs the resident catalog and a database file; writing synchronously.");
+            config.write_behind = false;
+            return;
+        }
+        if (sqlite3_open(config.db_file.c_str(), &wb_db) != SQLITE_OK) {
+            notify("Cannot open the write-behind connection; writing synchronously.");
+            sqlite3_close(wb_db);
+            wb_db = nullptr;
+            config.write_behind = false;
+            return;
+        }
+        if (config.group_commit) {
+            notify("Group commit is off while write-behind is on.");
+            flush_group_commit();
+            config.group_commit = false;
+        }
+        sqlite3_busy_timeout(wb_db, 5000);
+        sqlite3_exec(wb_db, ("PRAGMA foreign_keys = ON;" + synchronous_pragma()).c_str(), nullptr, nullptr, nullptr);
+        wb_stmts.attach(wb_db);
+        metrics.attach(wb_db);
+        // Past every id the table has handed out, including loans since returned
+        next_issue_id = (int)count_rows(db, "SELECT MAX(IFNULL((SELECT seq FROM sqlite_sequence WHERE name = 'issued'), 0), "
+                                            "IFNULL((SELECT MAX(issue_id) FROM issued), 0), IFNULL((SELECT MAX(issue_id) FROM history), 0));");
+
+        WriteBehind<LoanWrite>::Options o;
+        o.max_lag = (size_t)max(1, config.write_behind_max_lag);
+        o.batch = min<size_t>(max<size_t>(1, o.max_lag / 2), 1024);
+        o.flush_ms = max(1, config.write_behind_ms);
+        write_behind.start(o, [this](vector<LoanWrite>& jobs) { return write_loans(jobs); },
+                           [this](const string& msg) { notify(msg); });
+    }
+
     // Initialize DB schema
     void init_schema() {
         const char* sql = R"(
@@ -206,7 +1200,13 @@ public:
                 total_copies INTEGER,
                 available_copies INTEGER,
                 avg_rating REAL DEFAULT 0,
-                total_ratings INTEGER DEFAULT 0
+                total_ratings INTEGER DEFAULT 0,
+                rating_sum INTEGER DEFAULT 0,
+                stars_1 INTEGER DEFAULT 0,
+                stars_2 INTEGER DEFAULT 0,
+                stars_3 INTEGER DEFAULT 0,
+                stars_4 INTEGER DEFAULT 0,
+                stars_5 INTEGER DEFAULT 0
             );
             CREATE TABLE IF NOT EXISTS users (
                 user_id INTEGER PRIMARY KEY,
@@ -217,9 +1217,10 @@ public:
             CREATE TABLE IF NOT EXISTS issued (
                 issue_id INTEGER PRIMARY KEY AUTOINCREMENT,
                 book_id INTEGER,
-                user_id INTEGER UNIQUE,
+                user_id INTEGER,
                 issue_datetime INTEGER,
                 due_datetime INTEGER,
+                copy_no INTEGER DEFAULT 0,
                 FOREIGN KEY (book_id) REFERENCES books(book_id),
                 FOREIGN KEY (user_id) REFERENCES users(user_id)
             );
@@ -235,132 +1236,1865 @@ public:
             );
         )";
         exec_sql(sql);
+        migrate_rating_columns();
+        migrate_issued_copies();
+        exec_sql("CREATE INDEX IF NOT EXISTS idx_issued_user ON issued(user_id);"
+                 "CREATE INDEX IF NOT EXISTS idx_issued_book ON issued(book_id, copy_no);");
+        exec_sql(BOOK_INDEXES_SQL);
+        exec_sql(HistoryPager::index_sql("history").c_str());
+        load_history_partitions();
+    }
+
+    // Secondary indexes on books; lazy mode answers top-rated/most-rated
+    // queries from them. A large import drops them and builds them again
+    // at the end (an import cut short is repaired by the next start).
+    static constexpr const char* BOOK_INDEXES_SQL =
+        "CREATE INDEX IF NOT EXISTS idx_books_rating ON books(avg_rating DESC, total_ratings DESC);"
+        "CREATE INDEX IF NOT EXISTS idx_books_ratings_count ON books(total_ratings DESC);";
+    static constexpr const char* DROP_BOOK_INDEXES_SQL =
+        "DROP INDEX IF EXISTS idx_books_rating;"
+        "DROP INDEX IF EXISTS idx_books_ratings_count;";
+
+    // The hot history table, then the archive partitions newest first
+    void load_history_partitions() {
+        vector<string> tables = {"history"};
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT name FROM sqlite_master WHERE type = 'table' AND name GLOB 'history_[0-9][0-9][0-9][0-9]' "
+                                   "ORDER BY name DESC;", -1, &stmt, nullptr) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) tables.push_back(column_string(stmt, 0));
+            sqlite3_finalize(stmt);
+        }
+        history_tables.swap(tables);
+    }
+
+    // Databases created before exact rating totals: add the columns and
+    // recover each sum from the stored average. Older ratings have no star
+    // breakdown.
+    void migrate_rating_columns() {
+        bool has_sum = false;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "PRAGMA table_info(books);", -1, &stmt, nullptr) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) has_sum = has_sum || column_string(stmt, 1) == "rating_sum";
+            sqlite3_finalize(stmt);
+        }
+        if (has_sum) return;
+        bool ok = exec_sql("BEGIN;"
+                           "ALTER TABLE books ADD COLUMN rating_sum INTEGER DEFAULT 0;"
+                           "ALTER TABLE books ADD COLUMN stars_1 INTEGER DEFAULT 0;"
+                           "ALTER TABLE books ADD COLUMN stars_2 INTEGER DEFAULT 0;"
+                           "ALTER TABLE books ADD COLUMN stars_3 INTEGER DEFAULT 0;"
+                           "ALTER TABLE books ADD COLUMN stars_4 INTEGER DEFAULT 0;"
+                           "ALTER TABLE books ADD COLUMN stars_5 INTEGER DEFAULT 0;"
+                           "UPDATE books SET rating_sum = CAST(ROUND(avg_rating * total_ratings) AS INTEGER) WHERE total_ratings > 0;"
+                           "UPDATE books SET avg_rating = CAST(rating_sum AS REAL) / total_ratings WHERE total_ratings > 0;"
+                           "COMMIT;");
+        if (!ok) exec_sql("ROLLBACK;");
+    }
+
+    // Databases from before multiple loans per user: issued had a UNIQUE
+    // user_id and no copy numbers. Rebuild it without the constraint,
+    // numbering each book's loans 1, 2, ... in issue order, and keep its
+    // AUTOINCREMENT counter so returned issue ids are not handed out again.
+    void migrate_issued_copies() {
+        bool has_copy = false;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "PRAGMA table_info(issued);", -1, &stmt, nullptr) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) has_copy = has_copy || column_string(stmt, 1) == "copy_no";
+            sqlite3_finalize(stmt);
+        }
+        if (has_copy) return;
+        size_t seq = count_rows(db, "SELECT IFNULL((SELECT seq FROM sqlite_sequence WHERE name = 'issued'), 0);");
+        string sql = "BEGIN;"
+                     "CREATE TABLE issued_new (issue_id INTEGER PRIMARY KEY AUTOINCREMENT, book_id INTEGER, user_id INTEGER, "
+                     "issue_datetime INTEGER, due_datetime INTEGER, copy_no INTEGER DEFAULT 0, "
+                     "FOREIGN KEY (book_id) REFERENCES books(book_id), FOREIGN KEY (user_id) REFERENCES users(user_id));"
+                     "INSERT INTO issued_new (issue_id, book_id, user_id, issue_datetime, due_datetime, copy_no) "
+                     "SELECT issue_id, book_id, user_id, issue_datetime, due_datetime, "
+                     "ROW_NUMBER() OVER (PARTITION BY book_id ORDER BY issue_id) FROM issued;"
+                     "DROP TABLE issued;"
+                     "ALTER TABLE issued_new RENAME TO issued;"
+                     "DELETE FROM sqlite_sequence WHERE name = 'issued';"
+                     "INSERT INTO sqlite_sequence (name, seq) VALUES ('issued', MAX(" + to_string(seq) + ", "
+                     "(SELECT IFNULL(MAX(issue_id), 0) FROM issued)));"
+                     "COMMIT;";
+        if (!exec_sql(sql.c_str())) exec_sql("ROLLBACK;");
+    }
+
+    // Operation log recovery: redo, in one transaction, the logged
+    // operations after the last one the tables hold (those acknowledged
+    // but lost with the process), then start an empty log. A log that
+    // cannot be replayed is set aside as <file>.failed.
+    struct LogRecovery {
+        size_t replayed = 0;
+        double seconds = 0.0;
+    };
+    LogRecovery log_recovery;
+
+    void open_oplog() {
+        auto start = chrono::steady_clock::now();
+        exec_sql("CREATE TABLE IF NOT EXISTS meta (key TEXT PRIMARY KEY, value INTEGER);");
+        uint64_t applied = (uint64_t)count_rows(db, "SELECT IFNULL((SELECT value FROM meta WHERE key = 'oplog_seq'), 0);");
+        uint64_t last = applied;
+        OpJournal::ScanStats scan;
+        string err;
+        bool ok = exec_sql("BEGIN IMMEDIATE;");
+        ok = ok && OpJournal::scan(config.oplog_file, [&](uint64_t seq, OpJournal::Cursor& c) {
+            if (seq <= applied) return true;
+            if (!replay_record(c)) return false;
+            log_recovery.replayed++;
+            last = seq;
+            return true;
+        }, scan, err);
+        if (ok && last > applied) {
+            ConnectionPool::Lease conn = writer_conn();
+            ok = mark_logged(conn, last);
+        }
+        if (!ok || !commit_transaction()) {
+            exec_sql("ROLLBACK;");
+            log_recovery.replayed = 0;
+            last = applied;
+            string kept = config.oplog_file + ".failed";
+            remove(kept.c_str());
+            rename(config.oplog_file.c_str(), kept.c_str());
+            notify("Operation log recovery failed" + (err.empty() ? string() : ": " + err) + "; the log was kept as " + kept);
+        }
+        if (scan.ignored_bytes) notify("Ignored " + to_string(scan.ignored_bytes) + " bytes of torn operation log tail.");
+        log_recovery.seconds = seconds_since(start);
+        if (log_recovery.replayed) {
+            ostringstream msg;
+            msg << "Recovered " << log_recovery.replayed << " operations from " << config.oplog_file << " in "
+                << fixed << setprecision(3) << log_recovery.seconds * 1000.0 << " ms";
+            notify(msg.str());
+        }
+        if (!oplog.open(config.oplog_file, max(last, scan.last_seq), config.oplog_sync_ms, err)) {
+            notify(err + "; running without an operation log.");
+        }
+    }
+
+    // Apply one log record to the tables; false on a malformed record or
+    // an SQL error. A loan whose copy is gone is skipped with a notice.
+    bool replay_record(OpJournal::Cursor& c) {
+        uint64_t kind;
+        if (!c.varint(kind)) return false;
+        ConnectionPool::Lease conn = writer_conn();
+        if (kind == LOG_ISSUE || kind == LOG_RETURN) {
+            LoanWrite w;
+            w.kind = kind == LOG_ISSUE ? LoanWrite::ISSUE : LoanWrite::RETURN;
+            if (!c.i32(w.issue_id) || !c.i32(w.book_id) || !c.i32(w.user_id) || !c.i64(w.at) || !c.i64(w.until) || !c.i32(w.rating)) return false;
+            if (c.p < c.end && !c.i32(w.copy_no)) return false;   // older records carry no copy number
+            int written = write_loan(conn, w);
+            if (written == 0) notify("Operation log: no copy of book " + to_string(w.book_id) + " left for issue " + to_string(w.issue_id) + "; skipped.");
+            return written >= 0;
+        }
+
+        int id = 0, count = 0;
+        string a, b;
+        if (!c.i32(id) || !c.i32(count) || !c.str(a) || !c.str(b)) return false;
+        const char* sql = nullptr;
+        switch (kind) {
+            case LOG_ADD_BOOK: sql = "INSERT OR REPLACE INTO books (book_id, title, author, total_copies, available_copies) VALUES (?1, ?3, ?4, ?2, ?2);"; break;
+            case LOG_REMOVE_BOOK: sql = "DELETE FROM books WHERE book_id = ?1;"; break;
+            case LOG_ADD_USER: sql = "INSERT OR REPLACE INTO users (user_id, name) VALUES (?1, ?3);"; break;
+            case LOG_REMOVE_USER: sql = "DELETE FROM users WHERE user_id = ?1;"; break;
+            default: return false;
+        }
+        StmtGuard st = conn.prepared(sql);
+        if (st) {
+            int params = sqlite3_bind_parameter_count(st.get());
+            sqlite3_bind_int(st.get(), 1, id);
+            if (params >= 2) sqlite3_bind_int(st.get(), 2, count);
+            if (params >= 3) sqlite3_bind_text(st.get(), 3, a.c_str(), -1, SQLITE_TRANSIENT);
+            if (params >= 4) sqlite3_bind_text(st.get(), 4, b.c_str(), -1, SQLITE_TRANSIENT);
+        }
+        return run_stmt(st, conn.db());
     }
 
     // Load all data from DB to memory (abstraction hides DB details)
+    // Rows and wall time of the last load, per table
+    struct TableLoadStats {
+        const char* table;
+        size_t rows;
+        double seconds;
+    };
+    TableLoadStats load_stats[3] = {{"books", 0, 0.0}, {"users", 0, 0.0}, {"issued", 0, 0.0}};
+
+    // The three tables are independent in memory, so each is streamed in on
+    // its own pooled reader and thread. Falls back to the main connection
+    // for in-memory databases or a pool of fewer than three readers.
     void load_all_data() {
-        load_books();
-        load_users();
-        load_issued();
+        Metrics::Timer timer(metrics, Metrics::LOAD);
+        if (lazy()) {
+            // Only loans and the penalty timers stay resident; rows fault in on use
+            load_defaulters();
+            load_issued(db);
+            refresh_deadlines(time(0));
+            return;
+        }
+
+        ConnectionPool::Lease conns[3] = {readers.try_acquire(), readers.try_acquire(), readers.try_acquire()};
+        if (conns[0] && conns[1] && conns[2]) {
+            thread tb([&] { load_books(conns[0].db()); });
+            thread tu([&] { load_users(conns[1].db()); });
+            load_issued(conns[2].db());
+            tb.join();
+            tu.join();
+        } else {
+            load_books(db);
+            load_users(db);
+            load_issued(db);
+        }
+        refresh_deadlines(time(0));
+    }
+
+    static size_t count_rows(sqlite3* conn, const char* sql) {
+        size_t n = 0;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) n = (size_t)sqlite3_column_int64(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        return n;
+    }
+
+    static string column_string(sqlite3_stmt* stmt, int col) {
+        const unsigned char* txt = sqlite3_column_text(stmt, col);
+        return txt ? string((const char*)txt, (size_t)sqlite3_column_bytes(stmt, col)) : string();
     }
 
-    void load_books() {
-        books.clear();
-        const char* sql = "SELECT book_id, title, author, total_copies, available_copies, avg_rating, total_ratings FROM books;";
+    // total_ratings, rating_sum, stars_1..stars_5 starting at column col
+    static RatingTally column_tally(sqlite3_stmt* stmt, int col) {
+        RatingTally r;
+        r.count = sqlite3_column_int(stmt, col);
+        r.sum = sqlite3_column_int64(stmt, col + 1);
+        for (int k = 0; k < 5; k++) r.stars[(size_t)k] = sqlite3_column_int(stmt, col + 2 + k);
+        return r;
+    }
+
+    static double seconds_since(chrono::steady_clock::time_point start) {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Loaders prepare directly: they run once, usually on a short-lived reader
+    void load_books(sqlite3* conn) {
+        auto start = chrono::steady_clock::now();
+        catalog.clear();
+        search_index.clear();
+        rating_index.clear();
+        catalog.reserve(count_rows(conn, "SELECT COUNT(*) FROM books;"));
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_prepare_v2(conn, "SELECT book_id, title, author, total_copies, available_copies, "
+                                     "total_ratings, rating_sum, stars_1, stars_2, stars_3, stars_4, stars_5 FROM books;", -1, &stmt, nullptr) == SQLITE_OK) {
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 int id = sqlite3_column_int(stmt, 0);
-                string title = (const char*)sqlite3_column_text(stmt, 1);
-                string author = (const char*)sqlite3_column_text(stmt, 2);
+                string title = column_string(stmt, 1);
+                string author = column_string(stmt, 2);
                 int total = sqlite3_column_int(stmt, 3);
                 int avail = sqlite3_column_int(stmt, 4);
-                double rating = sqlite3_column_double(stmt, 5);
-                int ratings = sqlite3_column_int(stmt, 6);
-                books[id] = Book(id, title, author, total, avail, rating, ratings);
+                RatingTally ratings = column_tally(stmt, 5);
+                search_index.add(id, title, author);
+                catalog.upsert(id, title, author, total, avail, ratings);
+                rating_index.insert(id, ratings);
             }
             sqlite3_finalize(stmt);
         }
+        load_stats[0].rows = catalog.size();
+        load_stats[0].seconds = seconds_since(start);
     }
 
-    void load_users() {
+    void load_users(sqlite3* conn) {
+        auto start = chrono::steady_clock::now();
         users.clear();
-        const char* sql = "SELECT user_id, name, is_defaulter, penalty_end FROM users;";
+        penalty_queue.clear();
+        users.reserve(count_rows(conn, "SELECT COUNT(*) FROM users;"));
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_prepare_v2(conn, "SELECT user_id, name, is_defaulter, penalty_end FROM users;", -1, &stmt, nullptr) == SQLITE_OK) {
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 int id = sqlite3_column_int(stmt, 0);
-                string name = (const char*)sqlite3_column_text(stmt, 1);
                 bool defaulter = sqlite3_column_int(stmt, 2) != 0;
                 time_t penalty = (time_t)sqlite3_column_int64(stmt, 3);
-                users[id] = User(id, name);
-                users[id].isDefaulter = defaulter;
-                users[id].penaltyEnd = penalty;
+                User& u = users.try_emplace(id, id, column_string(stmt, 1)).first->second;
+                u.isDefaulter = defaulter;
+                u.penaltyEnd = penalty;
+                if (defaulter) penalty_queue.schedule(id, penalty);
             }
             sqlite3_finalize(stmt);
         }
+        load_stats[1].rows = users.size();
+        load_stats[1].seconds = seconds_since(start);
     }
 
-    void load_issued() {
+    void load_defaulters() {
+        penalty_queue.clear();
+        StmtGuard st = prepared("SELECT user_id, penalty_end FROM users WHERE is_defaulter = 1;");
+        if (!st) return;
+        while (sqlite3_step(st.get()) == SQLITE_ROW) {
+            penalty_queue.schedule(sqlite3_column_int(st.get(), 0), (time_t)sqlite3_column_int64(st.get(), 1));
+        }
+    }
+
+    void load_issued(sqlite3* conn) {
+        auto start = chrono::steady_clock::now();
         issued.clear();
-        const char* sql = "SELECT issue_id, book_id, user_id, issue_datetime, due_datetime FROM issued;";
+        issues_by_user.clear();
+        issues_by_book.clear();
+        copies.clear();
+        due_queue.clear();
+        overdue_issues.clear();
+        overdue_notices.clear();
+        size_t n = count_rows(conn, "SELECT COUNT(*) FROM issued;");
+        issued.reserve(n);
+        issues_by_user.reserve(n);
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        // Ascending copy numbers let the registry claim each one in O(1)
+        if (sqlite3_prepare_v2(conn, "SELECT issue_id, book_id, user_id, issue_datetime, due_datetime, copy_no FROM issued ORDER BY copy_no;",
+                               -1, &stmt, nullptr) == SQLITE_OK) {
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 int iid = sqlite3_column_int(stmt, 0);
                 int bid = sqlite3_column_int(stmt, 1);
                 int uid = sqlite3_column_int(stmt, 2);
                 time_t issue = (time_t)sqlite3_column_int64(stmt, 3);
                 time_t due = (time_t)sqlite3_column_int64(stmt, 4);
-                issued[iid] = IssuedRecord(iid, bid, uid, issue, due);
+                int copy = sqlite3_column_int(stmt, 5);
+                if (!copies.claim(bid, copy)) copy = 0;   // duplicate or missing: audit reports it
+                add_issued(IssuedRecord(iid, bid, uid, issue, due, copy));
             }
             sqlite3_finalize(stmt);
         }
+        load_stats[2].rows = issued.size();
+        load_stats[2].seconds = seconds_since(start);
     }
 
-    // Save everything to DB
-    void save_all() {
-        save_books();
-        save_users();
-        save_issued();
+    // ----------------------
+    // Read API for clients (the console, the benchmarks, an embedding
+    // service): plain data out, formatting left to the caller. Calls that
+    // depend on the clock take `now` and first apply the due dates and
+    // penalty ends that have passed.
+    // ----------------------
+    bool find_book(int id, Book& out) { return get_book(id, out); }
+    bool find_user(int id, User& out) { return get_user(id, out); }
+    bool book_exists(int id) { return has_book(id); }
+    bool user_exists(int id) { return has_user(id); }
+    size_t total_books() { return book_count(); }
+    size_t total_users() { return user_count(); }
+    size_t active_loans() const { return issued.size(); }
+
+    bool check_admin_password(const string& pass) const {
+        return pass == ADMIN_PASS;
     }
 
-    void save_books() {
-        exec_sql("DELETE FROM books;");
-        const char* sql = "INSERT INTO books (book_id, title, author, total_copies, available_copies, avg_rating, total_ratings) VALUES (?, ?, ?, ?, ?, ?, ?);";
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            for (auto& p : books) {
-                const Book& b = p.second;
-                sqlite3_bind_int(stmt, 1, b.book_id());  // use accessor
-                sqlite3_bind_text(stmt, 2, b.title.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 3, b.author.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_int(stmt, 4, b.totalCopies);
-                sqlite3_bind_int(stmt, 5, b.availableCopies);
-                sqlite3_bind_double(stmt, 6, b.avg_rating);
-                sqlite3_bind_int(stmt, 7, b.total_ratings);
-                sqlite3_step(stmt);
-                sqlite3_reset(stmt);
+    // uid's active loan due first, if any
+    bool loan_of(int uid, IssuedRecord& out) const {
+        const IssuedRecord* r = active_issue_of(uid);
+        if (r) out = *r;
+        return r != nullptr;
+    }
+
+    // Every active loan of uid, due first first; found through the per-user
+    // index, so the cost is the number of loans the user holds
+    vector<IssuedRecord> loans_of(int uid) const {
+        vector<IssuedRecord> out;
+        auto u = issues_by_user.find(uid);
+        if (u == issues_by_user.end()) return out;
+        for (int iid : u->second) {
+            auto it = issued.find(iid);
+            if (it != issued.end()) out.push_back(it->second);
+        }
+        sort(out.begin(), out.end(), [](const IssuedRecord& a, const IssuedRecord& b) {
+            return a.dueDatetime != b.dueDatetime ? a.dueDatetime < b.dueDatetime : a.issue_id() < b.issue_id();
+        });
+        return out;
+    }
+
+    size_t loan_count(int uid) const { return loans_held(uid); }
+    int loan_limit() const { return max(1, config.max_loans); }
+
+    // Printed and scanned copy identity: BOOKID-COPYNO
+    static string barcode(int book_id, int copy_no) {
+        return to_string(book_id) + "-" + (copy_no > 0 ? to_string(copy_no) : "?");
+    }
+
+    // Per-copy inventory of a book: one entry per copy 1..totalCopies, plus
+    // any loan whose copy number is unknown or out of range
+    struct CopyStatus {
+        int copy_no = 0;
+        int issue_id = 0;   // 0 = on the shelf
+        int user_id = 0;
+        time_t due = 0;
+    };
+
+    bool copy_status(int book_id, vector<CopyStatus>& out) {
+        Book b;
+        if (!get_book(book_id, b)) return false;
+        out.assign((size_t)max(0, b.totalCopies), CopyStatus());
+        for (size_t i = 0; i < out.size(); i++) out[i].copy_no = (int)i + 1;
+        auto loans = issues_by_book.find(book_id);
+        if (loans == issues_by_book.end()) return true;
+        for (int iid : loans->second) {
+            auto it = issued.find(iid);
+            if (it == issued.end()) continue;
+            const IssuedRecord& r = it->second;
+            CopyStatus c;
+            c.copy_no = r.copy_no;
+            c.issue_id = r.issue_id();
+            c.user_id = r.user_id;
+            c.due = r.dueDatetime;
+            if (r.copy_no >= 1 && r.copy_no <= b.totalCopies && out[(size_t)r.copy_no - 1].issue_id == 0) out[(size_t)r.copy_no - 1] = c;
+            else out.push_back(c);
+        }
+        return true;
+    }
+
+    // Every book / user, in storage order; the visitor may return false to stop
+    template <class Fn>
+    void visit_books(Fn&& fn) {
+        for_each_book(std::forward<Fn>(fn));
+    }
+
+    template <class Fn>
+    void visit_users(Fn&& fn) {
+        for_each_user(std::forward<Fn>(fn));
+    }
+
+    void apply_deadlines(time_t now) {
+        refresh_deadlines(now);
+    }
+
+    // Users still under penalty, earliest penalty end first
+    vector<User> defaulters(time_t now) {
+        refresh_deadlines(now);
+        vector<User> out;
+        penalty_queue.for_each([&](int uid, time_t) {
+            User u;
+            if (get_user(uid, u)) out.push_back(u);
+        });
+        return out;
+    }
+
+    // Overdue notices: loans that went overdue since the last call, drained
+    // from the due-date queue rather than found by scanning every loan.
+    struct OverdueReport {
+        vector<IssuedRecord> notices;   // still out; returned loans are dropped
+        size_t overdue = 0;             // loans past their due date right now
+        size_t penalties_ending = 0;    // penalties ending within 24 hours
+    };
+
+    OverdueReport take_overdue_notices(time_t now) {
+        refresh_deadlines(now);
+        OverdueReport report;
+        for (int issue_id : overdue_notices) {
+            auto it = issued.find(issue_id);
+            if (it != issued.end()) report.notices.push_back(it->second);
+        }
+        overdue_notices.clear();
+        report.overdue = overdue_issues.size();
+        penalty_queue.for_each_before(now + 24 * 60 * 60, [&](int, time_t) { report.penalties_ending++; });
+        return report;
+    }
+
+    // Catalog summary: whole-catalog totals. Resident mode scans the catalog
+    // columns directly; lazy mode asks SQLite for the same aggregates.
+    static constexpr double TOP_RATING = 4.0;
+
+    struct CatalogTotals {
+        long long titles = 0, copies = 0, available = 0;
+        long long in_stock = 0;    // titles with a copy on the shelf
+        long long top_rated = 0;   // rated TOP_RATING or above
+    };
+
+    bool catalog_totals(CatalogTotals& t) {
+        if (!lazy()) {
+            t.titles = (long long)catalog.size();
+            t.copies = catalog.sum_total_copies();
+            t.available = catalog.sum_available_copies();
+            t.in_stock = (long long)catalog.count_available();
+            t.top_rated = (long long)catalog.count_rated_at_least(TOP_RATING);
+            return true;
+        }
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared("SELECT COUNT(*), TOTAL(total_copies), TOTAL(available_copies), "
+                                     "COUNT(CASE WHEN available_copies > 0 THEN 1 END), "
+                                     "COUNT(CASE WHEN avg_rating >= ? AND total_ratings > 0 THEN 1 END) FROM books;");
+        if (!st) return false;
+        sqlite3_stmt* stmt = st.get();
+        sqlite3_bind_double(stmt, 1, TOP_RATING);
+        if (sqlite3_step(stmt) != SQLITE_ROW) return false;
+        t.titles = sqlite3_column_int64(stmt, 0);
+        t.copies = sqlite3_column_int64(stmt, 1);
+        t.available = sqlite3_column_int64(stmt, 2);
+        t.in_stock = sqlite3_column_int64(stmt, 3);
+        t.top_rated = sqlite3_column_int64(stmt, 4);
+        return true;
+    }
+
+    // What is held in memory: every row in resident mode, the two LRU
+    // caches in lazy mode
+    struct CacheReport {
+        size_t entries = 0, bytes = 0, capacity = 0;
+        CacheStats stats;
+    };
+
+    struct MemoryReport {
+        bool lazy = false;
+        size_t books = 0, users = 0, loans = 0;
+        size_t catalog_bytes = 0, distinct_strings = 0;   // resident mode
+        CacheReport book_cache, user_cache;                // lazy mode
+    };
+
+    MemoryReport memory_report() const {
+        MemoryReport m;
+        m.lazy = lazy();
+        m.books = catalog.size();
+        m.users = users.size();
+        m.loans = issued.size();
+        m.catalog_bytes = catalog.bytes();
+        m.distinct_strings = catalog.distinct_strings();
+        m.book_cache = {book_cache.size(), book_cache.footprint(), book_cache.capacity(), book_cache.statistics()};
+        m.user_cache = {user_cache.size(), user_cache.footprint(), user_cache.capacity(), user_cache.statistics()};
+        return m;
+    }
+
+    // ----------------------
+    // Metrics (metrics.h): operation latencies, SQLite counters and the
+    // sizes of the in-memory structures as one JSON line. Shown by admin
+    // option 19 and the `metrics` command. SIGUSR1 writes it to
+    // config.metrics_file at the next safe point: the server's next tick,
+    // or the next menu choice or batch command.
+    // ----------------------
+    inline static volatile sig_atomic_t metrics_dump_requested = 0;
+
+    string metrics_json() {
+        size_t pending = dirty_books.size() + dirty_users.size() + dirty_issued.size()
+                       + deleted_books.size() + deleted_users.size() + deleted_issued.size();
+        const CacheStats& bc = book_cache.statistics();
+        const CacheStats& uc = user_cache.statistics();
+        WriteBehind<LoanWrite>::Stats wb = write_behind.stats();
+        return metrics.to_json(
+            {{"rows_changed", sqlite3_total_changes(db)},
+             {"statements_cached", (int64_t)stmts.size()},
+             {"read_connections", (int64_t)readers.size()},
+             {"write_behind_batches", (int64_t)wb.batches},
+             {"write_behind_retries", (int64_t)wb.retries},
+             {"oplog_seq", (int64_t)oplog.last_seq()}},
+            {{"books_resident", (int64_t)catalog.size()},
+             {"catalog_bytes", (int64_t)catalog.bytes()},
+             {"users_resident", (int64_t)users.size()},
+             {"active_loans", (int64_t)issued.size()},
+             {"books_on_loan", (int64_t)copies.size()},
+             {"due_timers", (int64_t)due_queue.size()},
+             {"penalty_timers", (int64_t)penalty_queue.size()},
+             {"search_terms", (int64_t)search_index.size()},
+             {"rated_books", (int64_t)rating_index.size()},
+             {"history_partitions", (int64_t)history_tables.size()},
+             {"dirty_rows", (int64_t)pending},
+             {"write_behind_pending", (int64_t)write_behind.pending()},
+             {"oplog_records", (int64_t)oplog.records()},
+             {"book_cache_entries", (int64_t)book_cache.size()},
+             {"book_cache_bytes", (int64_t)book_cache.footprint()},
+             {"book_cache_hits", (int64_t)bc.hits},
+             {"book_cache_misses", (int64_t)bc.misses},
+             {"user_cache_entries", (int64_t)user_cache.size()},
+             {"user_cache_bytes", (int64_t)user_cache.footprint()},
+             {"user_cache_hits", (int64_t)uc.hits},
+             {"user_cache_misses", (int64_t)uc.misses}});
+    }
+
+    // Replace path with the current metrics (written to a temporary file first)
+    bool write_metrics(const string& path) {
+        string tmp = path + ".tmp";
+        {
+            ofstream out(tmp, ios::binary | ios::trunc);
+            if (!out) return false;
+            out << metrics_json() << "\n";
+            if (!out.flush()) return false;
+        }
+        remove(path.c_str());   // rename() does not replace on Windows
+        return rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    void dump_metrics_if_requested() {
+        if (!metrics_dump_requested) return;
+        metrics_dump_requested = 0;
+        if (write_metrics(config.metrics_file)) notify("Metrics written to " + config.metrics_file);
+        else notify("Cannot write metrics to " + config.metrics_file);
+    }
+
+    // Mark every resident book and user changed, so the next save_all()
+    // rewrites all of them (the worst case, measured by the benchmarks).
+    // Lazy mode holds no full copy, so nothing is marked there.
+    void mark_all_dirty() {
+        mark_rows_dirty(numeric_limits<size_t>::max());
+    }
+
+    // Mark up to n more resident rows changed, books first, then users;
+    // returns how many were marked (the benchmarks' incremental saves)
+    size_t mark_rows_dirty(size_t n) {
+        StateLock lock(state_mutex);
+        size_t marked = 0;
+        for (uint32_t slot = 0; slot < catalog.size() && marked < n; slot++) {
+            if (catalog.dirty[slot]) continue;
+            catalog.dirty[slot] = 1;
+            dirty_books.push_back(catalog.ids[slot]);
+            marked++;
+        }
+        for (auto it = users.begin(); it != users.end() && marked < n; ++it) {
+            if (it->second.isDirty()) continue;
+            mark_user_dirty(it->second);
+            marked++;
+        }
+        return marked;
+    }
+
+    // Save changed rows to DB in one transaction.
+    // Returns the number of rows written, or -1 if the save was rolled back
+    // (pending changes are kept so the next save retries them).
+    int save_all() {
+        Metrics::Timer timer(metrics, Metrics::SAVE);
+        if (!flush_group_commit()) return -1;   // acknowledged operations first
+        checkpoint_oplog();
+        size_t pending = dirty_books.size() + dirty_users.size() + dirty_issued.size()
+                       + deleted_books.size() + deleted_users.size() + deleted_issued.size();
+        if (pending == 0) return 0;
+
+        if (!exec_sql("BEGIN;")) return -1;
+        int rows = 0;
+        // Deletes go child-first and upserts parent-first to respect the foreign keys
+        bool ok = delete_rows("DELETE FROM issued WHERE issue_id = ?;", deleted_issued, rows)
+               && delete_rows("DELETE FROM users WHERE user_id = ?;", deleted_users, rows)
+               && delete_rows("DELETE FROM books WHERE book_id = ?;", deleted_books, rows)
+               && save_books(rows)
+               && save_users(rows)
+               && save_issued(rows);
+        if (!ok || !commit_transaction()) {
+            exec_sql("ROLLBACK;");
+            return -1;
+        }
+
+        StateLock lock(state_mutex);
+        for (int id : dirty_books) {
+            if (!lazy()) {
+                uint32_t slot = catalog.find(id);
+                if (slot != CatalogStore::NPOS) catalog.dirty[slot] = 0;
+            } else if (Book* b = book_cache.peek(id)) {
+                b->clearDirty();
             }
-            sqlite3_finalize(stmt);
         }
+        for (int id : dirty_users) if (User* u = resident_user(id)) u->clearDirty();
+        for (int id : dirty_issued) if (issued.count(id)) issued[id].clearDirty();
+        dirty_books.clear(); dirty_users.clear(); dirty_issued.clear();
+        deleted_books.clear(); deleted_users.clear(); deleted_issued.clear();
+        return rows;
     }
 
-    void save_users() {
-        exec_sql("DELETE FROM users;");
-        const char* sql = "INSERT INTO users (user_id, name, is_defaulter, penalty_end) VALUES (?, ?, ?, ?);";
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            for (auto& p : users) {
-                const User& u = p.second;
-                sqlite3_bind_int(stmt, 1, u.user_id()); // accessor
-                sqlite3_bind_text(stmt, 2, u.name.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_int(stmt, 3, u.isDefaulter ? 1 : 0);
-                sqlite3_bind_int64(stmt, 4, (sqlite3_int64)u.penaltyEnd);
-                sqlite3_step(stmt);
-                sqlite3_reset(stmt);
+    // Commit what earlier operations left pending: the shared group-commit
+    // transaction, if one is open, or the write-behind queue. The group's
+    // operations are acknowledged and already in memory, so a failed COMMIT
+    // must not drop them: it is retried while the transaction is still
+    // open, and a group SQLite rolled back is written again from its log
+    // records. False if they are still not in the database; they are kept
+    // and the next flush tries again.
+    bool flush_group_commit() {
+        write_behind.flush();
+        cancel_dropped_issues();
+        if (!group_pending()) return true;
+        for (int attempt = 1; attempt <= GROUP_COMMIT_ATTEMPTS; attempt++) {
+            if (attempt > 1) this_thread::sleep_for(chrono::milliseconds(GROUP_RETRY_MS));
+            if (!group_open && !rewrite_group()) continue;
+            if (commit_transaction()) {
+                group_open = false;
+                group_records.clear();
+                return true;
             }
-            sqlite3_finalize(stmt);
+            group_open = !sqlite3_get_autocommit(db);
         }
+        notify("Could not commit " + to_string(group_records.size()) + " operations; they are kept and will be written again.");
+        return false;
     }
 
-    void save_issued() {
-        exec_sql("DELETE FROM issued;");
-        const char* sql = "INSERT INTO issued (issue_id, book_id, user_id, issue_datetime, due_datetime) VALUES (?, ?, ?, ?, ?);";
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            for (auto& p : issued) {
-                const IssuedRecord& r = p.second;
-                sqlite3_bind_int(stmt, 1, r.issue_id()); // accessor
-                sqlite3_bind_int(stmt, 2, r.book_id);
-                sqlite3_bind_int(stmt, 3, r.user_id);
-                sqlite3_bind_int64(stmt, 4, (sqlite3_int64)r.issueDatetime);
-                sqlite3_bind_int64(stmt, 5, (sqlite3_int64)r.dueDatetime);
-                sqlite3_step(stmt);
-                sqlite3_reset(stmt);
+    // Open a new group transaction holding the operations of one that was
+    // rolled back
+    bool rewrite_group() {
+        if (!exec_cached("BEGIN IMMEDIATE;")) return false;
+        bool ok = true;
+        for (size_t i = 0; ok && i < group_records.size(); i++) {
+            OpJournal::Cursor c{group_records[i].data(), group_records[i].data() + group_records[i].size()};
+            ok = replay_record(c);
+        }
+        if (ok && oplog.is_open()) {
+            ConnectionPool::Lease conn = writer_conn();
+            ok = mark_logged(conn, oplog.last_seq());
+        }
+        if (!ok) {
+            exec_cached("ROLLBACK;");
+            return false;
+        }
+        group_open = true;
+        group_ops = (int)group_records.size();
+        group_started = chrono::steady_clock::now();
+        return true;
+    }
+
+    // "issue 12 (book 3, user 7)": a log record, for messages
+    static string describe_record(const string& rec) {
+        OpJournal::Cursor c{rec.data(), rec.data() + rec.size()};
+        uint64_t kind = 0;
+        int id = 0, book = 0, user = 0;
+        c.varint(kind);
+        c.i32(id);
+        switch (kind) {
+            case LOG_ISSUE:
+            case LOG_RETURN:
+                c.i32(book);
+                c.i32(user);
+                return string(kind == LOG_ISSUE ? "issue " : "return of issue ") + to_string(id)
+                     + " (book " + to_string(book) + ", user " + to_string(user) + ")";
+            case LOG_ADD_BOOK: return "add book " + to_string(id);
+            case LOG_REMOVE_BOOK: return "remove book " + to_string(id);
+            case LOG_ADD_USER: return "add user " + to_string(id);
+            case LOG_REMOVE_USER: return "remove user " + to_string(id);
+            default: return "unknown operation";
+        }
+    }
+
+    bool delete_rows(const char* sql, const vector<int>& ids, int& rows) {
+        if (ids.empty()) return true;
+        StmtGuard st = prepared(sql);
+        if (!st) return false;
+        for (int id : ids) {
+            sqlite3_bind_int(st.get(), 1, id);
+            if (!st.run()) return false;
+            rows += sqlite3_changes(db);
+        }
+        return true;
+    }
+
+    // Copy counts and rating totals are written for new rows only; existing
+    // rows get them from the relative updates made at issue and return time
+    bool write_book_row(const Book& b) {
+        StmtGuard st = prepared("INSERT INTO books (book_id, title, author, total_copies, available_copies, avg_rating, total_ratings, "
+                                "rating_sum, stars_1, stars_2, stars_3, stars_4, stars_5) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?) "
+                                "ON CONFLICT(book_id) DO UPDATE SET title = excluded.title, author = excluded.author, "
+                                "total_copies = excluded.total_copies;");
+        if (!st) return false;
+        sqlite3_stmt* stmt = st.get();
+        sqlite3_bind_int(stmt, 1, b.book_id());  // use accessor
+        sqlite3_bind_text(stmt, 2, b.title.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, b.author.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 4, b.totalCopies);
+        sqlite3_bind_int(stmt, 5, b.availableCopies);
+        sqlite3_bind_double(stmt, 6, b.ratings.average());
+        sqlite3_bind_int(stmt, 7, b.ratings.count);
+        sqlite3_bind_int64(stmt, 8, b.ratings.sum);
+        for (int k = 0; k < 5; k++) sqlite3_bind_int(stmt, 9 + k, b.ratings.stars[(size_t)k]);
+        return st.run();
+    }
+
+    bool write_user_row(const User& u) {
+        StmtGuard st = prepared("INSERT INTO users (user_id, name, is_defaulter, penalty_end) VALUES (?, ?, ?, ?) "
+                                "ON CONFLICT(user_id) DO UPDATE SET name = excluded.name, "
+                                "is_defaulter = excluded.is_defaulter, penalty_end = excluded.penalty_end;");
+        if (!st) return false;
+        sqlite3_stmt* stmt = st.get();
+        sqlite3_bind_int(stmt, 1, u.user_id()); // accessor
+        sqlite3_bind_text(stmt, 2, u.name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 3, u.isDefaulter ? 1 : 0);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)u.penaltyEnd);
+        return st.run();
+    }
+
+    // Dirty rows that were evicted from the lazy cache were written back then
+    bool save_books(int& rows) {
+        Book scratch;
+        for (int id : dirty_books) {
+            const Book* b = nullptr;
+            if (!lazy()) {
+                uint32_t slot = catalog.find(id);
+                if (slot != CatalogStore::NPOS) {
+                    read_slot(slot, scratch);
+                    b = &scratch;
+                }
+            } else {
+                b = book_cache.peek(id);
             }
-            sqlite3_finalize(stmt);
+            if (!b || !b->isDirty()) continue;  // removed or evicted since
+            if (!write_book_row(*b)) return false;
+            rows++;
+        }
+        return true;
+    }
+
+    bool save_users(int& rows) {
+        for (int id : dirty_users) {
+            const User* u = resident_user(id);
+            if (!u || !u->isDirty()) continue;
+            if (!write_user_row(*u)) return false;
+            rows++;
+        }
+        return true;
+    }
+
+    bool save_issued(int& rows) {
+        if (dirty_issued.empty()) return true;
+        const char* sql = "INSERT INTO issued (issue_id, book_id, user_id, issue_datetime, due_datetime, copy_no) VALUES (?, ?, ?, ?, ?, ?) "
+                          "ON CONFLICT(issue_id) DO UPDATE SET book_id = excluded.book_id, user_id = excluded.user_id, "
+                          "issue_datetime = excluded.issue_datetime, due_datetime = excluded.due_datetime, copy_no = excluded.copy_no;";
+        StmtGuard st = prepared(sql);
+        if (!st) return false;
+        sqlite3_stmt* stmt = st.get();
+        for (int id : dirty_issued) {
+            auto it = issued.find(id);
+            if (it == issued.end()) continue;
+            const IssuedRecord& r = it->second;
+            sqlite3_bind_int(stmt, 1, r.issue_id()); // accessor
+            sqlite3_bind_int(stmt, 2, r.book_id);
+            sqlite3_bind_int(stmt, 3, r.user_id);
+            sqlite3_bind_int64(stmt, 4, (sqlite3_int64)r.issueDatetime);
+            sqlite3_bind_int64(stmt, 5, (sqlite3_int64)r.dueDatetime);
+            sqlite3_bind_int(stmt, 6, r.copy_no);
+            if (!st.run()) return false;
+            rows++;
+        }
+        return true;
+    }
+
+    static string epochToStr(time_t t) {
+        if (t == 0) return "-";
+        char buf[64];
+        struct tm tmv;
+#ifdef _WIN32
+        localtime_s(&tmv, &t);
+#else
+        localtime_r(&t, &tmv);   // localtime() shares one buffer across threads
+#endif
+        strftime(buf, sizeof(buf), "%Y-%m-%d", &tmv);
+        return string(buf);
+    }
+
+    // Book operations
+    OpResult add_book(const string& title, const string& author, int total) {
+        Metrics::Timer timer(metrics, Metrics::ADD_BOOK);
+        if (total <= 0) return {false, 0, "Invalid number.", OpStatus::INVALID};
+        if (!begin_op()) return {false, 0, "Add failed; please try again."};
+
+        StmtGuard st = prepared("INSERT INTO books (title, author, total_copies, available_copies) VALUES (?, ?, ?, ?);");
+        if (st) {
+            sqlite3_stmt* stmt = st.get();
+            sqlite3_bind_text(stmt, 1, title.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, author.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 3, total);
+            sqlite3_bind_int(stmt, 4, total);
+        }
+        bool ok = run_stmt(st);
+        int book_id = ok ? get_last_insert_rowid() : 0;
+        if (!ok || !commit_op(log_record(LOG_ADD_BOOK, book_id, total, title, author))) {
+            rollback_op();
+            return {false, 0, "Add failed; nothing was changed."};
+        }
+
+        StateLock lock(state_mutex);
+        if (!lazy()) search_index.add(book_id, title, author);
+        put_book(Book(book_id, title, author, total, total));
+        return {true, book_id, "Book added successfully. ID: " + to_string(book_id)};
+    }
+
+    OpResult remove_book(int book_id) {
+        Metrics::Timer timer(metrics, Metrics::REMOVE_BOOK);
+        Book b;
+        if (!get_book(book_id, b)) return {false, 0, "Book not found.", OpStatus::NOT_FOUND};
+
+        // Check if any active issues
+        if (issues_by_book.count(book_id)) return {false, 0, "Cannot remove; active issued copies exist.", OpStatus::REFUSED};
+
+        if (!begin_op()) return {false, 0, "Remove failed; please try again."};
+        StmtGuard st = prepared("DELETE FROM books WHERE book_id = ?;");
+        if (st) sqlite3_bind_int(st.get(), 1, book_id);
+        if (!run_stmt(st) || !commit_op(log_record(LOG_REMOVE_BOOK, book_id))) {
+            rollback_op();
+            return {false, 0, "Remove failed; nothing was changed."};
+        }
+
+        StateLock lock(state_mutex);
+        if (!lazy()) search_index.remove(book_id, b.title, b.author);
+        erase_book(book_id);
+        return {true, 0, "Book removed."};
+    }
+
+    // Top matches for a title/author query, best first
+    vector<int> search_ids(const string& query) {
+        Metrics::Timer timer(metrics, Metrics::SEARCH);
+        vector<int> ids;
+        if (lazy()) {
+            ids = search_catalog_sql(query, SEARCH_LIMIT);
+        } else {
+            for (auto& h : search_index.search(query, SEARCH_LIMIT)) ids.push_back(h.id);
+        }
+        return ids;
+    }
+
+    // Lazy mode keeps no in-memory index; every word must appear in the
+    // title or author (LIKE is case-insensitive for ASCII).
+    vector<int> search_catalog_sql(const string& query, size_t limit) {
+        vector<int> ids;
+        vector<string> words;
+        SearchIndex::tokenize(query, words);
+        if (words.empty()) return ids;
+        if (words.size() > 4) words.resize(4);   // bounds the number of distinct cached statements
+
+        string sql = "SELECT book_id FROM books WHERE 1";
+        for (size_t i = 0; i < words.size(); i++) sql += " AND (title LIKE ?1" + to_string(i) + " OR author LIKE ?1" + to_string(i) + ")";
+        sql += " ORDER BY book_id LIMIT ?2;";
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared(sql.c_str());
+        if (!st) return ids;
+        for (size_t i = 0; i < words.size(); i++) {
+            string pattern = "%" + words[i] + "%";
+            sqlite3_bind_text(st.get(), 10 + (int)i, pattern.c_str(), -1, SQLITE_TRANSIENT);
+        }
+        sqlite3_bind_int(st.get(), 2, (int)limit);
+        while (sqlite3_step(st.get()) == SQLITE_ROW) ids.push_back(sqlite3_column_int(st.get(), 0));
+        return ids;
+    }
+
+// User operations
+    OpResult add_user(int id, const string& name) {
+        Metrics::Timer timer(metrics, Metrics::ADD_USER);
+        if (has_user(id)) return {false, 0, "User exists.", OpStatus::EXISTS};
+        if (!begin_op()) return {false, 0, "Add failed; please try again."};
+        if (!insert_user_row(id, name) || !commit_op(log_record(LOG_ADD_USER, id, 0, name))) {
+            rollback_op();
+            return {false, 0, "Add failed; nothing was changed."};
+        }
+        StateLock lock(state_mutex);
+        put_user(User(id, name));
+        return {true, id, "User added."};
+    }
+
+    OpResult remove_user(int id) {
+        Metrics::Timer timer(metrics, Metrics::REMOVE_USER);
+        if (!has_user(id)) return {false, 0, "User not found.", OpStatus::NOT_FOUND};
+        if (loans_held(id)) return {false, 0, "Cannot remove; user has active issued book.", OpStatus::REFUSED};
+
+        if (!begin_op()) return {false, 0, "Remove failed; please try again."};
+        StmtGuard st = prepared("DELETE FROM users WHERE user_id = ?;");
+        if (st) sqlite3_bind_int(st.get(), 1, id);
+        if (!run_stmt(st) || !commit_op(log_record(LOG_REMOVE_USER, id))) {
+            rollback_op();
+            return {false, 0, "Remove failed; nothing was changed."};
+        }
+        StateLock lock(state_mutex);
+        erase_user(id);
+        penalty_queue.cancel(id);
+        return {true, 0, "User removed."};
+    }
+
+// Issue/Return operations
+    // Whether uid may borrow right now; if not, the status and message say why
+    OpResult can_borrow(int uid, time_t now) {
+        refresh_deadlines(now);
+        User u;
+        if (!get_user(uid, u)) return {false, 0, "User not found.", OpStatus::NOT_FOUND};
+        if (u.isDefaulter && now < u.penaltyEnd) {
+            return {false, 0, "You are a defaulter until: " + epochToStr(u.penaltyEnd), OpStatus::REFUSED};
+        }
+        size_t held = loans_held(uid);
+        if (held >= (size_t)loan_limit()) {
+            if (loan_limit() == 1) return {false, 0, "You already have an active issued book.", OpStatus::REFUSED};
+            return {false, 0, "You already have " + to_string(held) + " books on loan (the limit is " + to_string(loan_limit()) + ").", OpStatus::REFUSED};
         }
+        return {true, 0, ""};
+    }
+
+    // Claim one copy of book_id for an issue about to be written. In resident
+    // mode this is a CAS on the catalog's counter under the shared lock, so
+    // claims run in parallel and a book can never be promised to more
+    // borrowers than it has copies. Lazy mode is fully serialized and only
+    // checks the cached count; the conditional UPDATE has the final say.
+    bool reserve_copy(int book_id) {
+        shared_lock<shared_mutex> lock(state_mutex);
+        if (lazy()) {
+            Book* b = book_entry(book_id);
+            return b && b->availableCopies > 0;
+        }
+        uint32_t slot = catalog.find(book_id);
+        return slot != CatalogStore::NPOS && catalog.available_copies[slot].try_take();
+    }
+
+    // copy_no: the copy number taken for the claim, if any, goes back too
+    void release_copy(int book_id, int copy_no = 0) {
+        if (copy_no) {
+            StateLock lock(state_mutex);
+            copies.release(book_id, copy_no);
+        }
+        if (lazy()) return;
+        shared_lock<shared_mutex> lock(state_mutex);
+        uint32_t slot = catalog.find(book_id);
+        if (slot != CatalogStore::NPOS) catalog.available_copies[slot].give_back(catalog.total_copies[slot]);
+    }
+
+    // A claimed copy that goes back on the shelf unless the issue commits
+    struct CopyClaim {
+        Library* lib;
+        int book_id;
+        int copy_no = 0;
+        ~CopyClaim() {
+            if (lib) lib->release_copy(book_id, copy_no);
+        }
+    };
+
+    // reserved: the caller already holds a copy from reserve_copy
+    OpResult issue_book(int uid, int book_id, time_t now, bool reserved = false) {
+        Metrics::Timer timer(metrics, Metrics::ISSUE);
+        CopyClaim claim{reserved ? this : nullptr, book_id};
+        OpResult allowed = can_borrow(uid, now);
+        if (!allowed.ok) return allowed;
+
+        Book b;
+        if (!get_book(book_id, b)) return {false, 0, "Book not found.", OpStatus::NOT_FOUND};
+        if (active_issue_of(uid, book_id)) return {false, 0, "You already have a copy of this book.", OpStatus::REFUSED};
+        if (!claim.lib) {
+            if (!reserve_copy(book_id)) return {false, 0, "No available copies.", OpStatus::UNAVAILABLE};
+            claim.lib = this;
+        }
+        {
+            // Which copy goes out: the count above says one is free, the
+            // registry says which
+            StateLock lock(state_mutex);
+            claim.copy_no = copies.take(book_id, b.totalCopies);
+        }
+        if (!claim.copy_no) return {false, 0, "No available copies.", OpStatus::UNAVAILABLE};
+
+        // Issue book: issued row, history row and copy count commit together
+        // (or are queued together in write-behind mode)
+        time_t issueTime = now;
+        time_t dueTime = issueTime + (15LL * 24 * 60 * 60); // 15 days
+        LoanWrite w;
+        w.book_id = book_id;
+        w.user_id = uid;
+        w.at = issueTime;
+        w.until = dueTime;
+        w.copy_no = claim.copy_no;
+
+        if (write_behind.active()) {
+            w.issue_id = ++next_issue_id;
+        } else {
+            if (!begin_op()) return {false, 0, "Issue failed; please try again."};
+            ConnectionPool::Lease conn = writer_conn();
+            int written = write_loan(conn, w);
+            if (written == 0) {
+                rollback_op();
+                return {false, 0, "No available copies.", OpStatus::UNAVAILABLE};
+            }
+            if (written < 0 || !commit_op(log_record(w))) {
+                rollback_op();
+                return {false, 0, "Issue failed; nothing was changed."};
+            }
+        }
+        int issue_id = w.issue_id;
+
+        // Committed (or queued): the claimed copy is now the loan's
+        claim.lib = nullptr;
+        if (write_behind.active()) {
+            w.seq = log_op(log_record(w));
+            write_behind.push(w);
+        }
+        StateLock lock(state_mutex);
+        if (lazy()) {
+            b.availableCopies--;
+            put_book(b);
+        }
+        mark_issued_dirty(add_issued(IssuedRecord(issue_id, book_id, uid, issueTime, dueTime, w.copy_no)));
+
+        return {true, issue_id, "Issued successfully! Issue ID: " + to_string(issue_id) + " | Due: " + epochToStr(dueTime)
+                                    + " | Copy: " + barcode(book_id, w.copy_no)};
+    }
+
+    // Return uid's loan of book_id, or with book_id 0 the only loan uid has.
+    // rating is 1-5, or 0 to leave the book's rating unchanged.
+    OpResult return_book(int uid, int rating, time_t now, int book_id = 0) {
+        Metrics::Timer timer(metrics, Metrics::RETURN);
+        User u;
+        if (!get_user(uid, u)) return {false, 0, "User not found.", OpStatus::NOT_FOUND};
+
+        size_t held = loans_held(uid);
+        if (held == 0) return {false, 0, "No active issued books.", OpStatus::NOT_FOUND};
+        if (!book_id && held > 1) {
+            return {false, 0, "You have " + to_string(held) + " books on loan; give the Book ID to return.", OpStatus::INVALID};
+        }
+        const IssuedRecord* active = book_id ? active_issue_of(uid, book_id) : active_issue_of(uid);
+        if (!active) return {false, 0, "No active loan of book " + to_string(book_id) + ".", OpStatus::NOT_FOUND};
+        if (rating < 0 || rating > 5) return {false, 0, "Invalid rating! Enter a number between 1 and 5.", OpStatus::INVALID};
+
+        IssuedRecord rec = *active;  // copy: the entry is erased below
+        int issue_id = rec.issue_id();
+        refresh_deadlines(now);
+
+        Book b;
+        bool hasBook = get_book(rec.book_id, b);
+
+        bool overdue = now > rec.dueDatetime;
+        time_t penaltyEnd = now + (7LL * 24 * 60 * 60); // 7 days penalty
+
+        LoanWrite w;
+        w.kind = LoanWrite::RETURN;
+        w.issue_id = issue_id;
+        w.book_id = hasBook ? rec.book_id : 0;
+        w.user_id = uid;
+        w.at = now;
+        w.until = overdue ? penaltyEnd : 0;
+        w.rating = rating;
+
+        if (write_behind.active()) {
+            w.seq = log_op(log_record(w));
+            write_behind.push(w);
+        } else {
+            if (!begin_op()) return {false, 0, "Return failed; please try again."};
+            ConnectionPool::Lease conn = writer_conn();
+            if (write_loan(conn, w) < 0 || !commit_op(log_record(w))) {
+                rollback_op();
+                return {false, 0, "Return failed; nothing was changed."};
+            }
+        }
+
+        // Committed (or queued): mirror it in memory
+        StateLock lock(state_mutex);
+        if (hasBook && get_book(rec.book_id, b)) {   // re-read: claims may have moved the count meanwhile
+            b.availableCopies = min(b.availableCopies + 1, b.totalCopies);
+            if (rating > 0) b.ratings.add(rating);
+            put_book(b);
+        }
+        erase_issued(issue_id);
+        deleted_issued.push_back(issue_id);
+
+        if (overdue) {
+            u.isDefaulter = true;
+            u.penaltyEnd = penaltyEnd;
+            put_user(u);
+            penalty_queue.schedule(uid, penaltyEnd);
+            return {true, issue_id, "Overdue return! You are marked as defaulter. Penalty until: " + epochToStr(penaltyEnd)};
+        }
+        return {true, issue_id, "Book returned successfully. Thank you!"};
+    }
+
+    // Copy-count audit: a book is oversubscribed when its count is negative,
+    // its count plus its active loans exceeds total_copies, or two loans
+    // hold the same copy number or one past total_copies. The table must
+    // also balance exactly (count + loans == total); in memory a pending
+    // claim may hold a copy that is not yet a loan.
+    OpResult audit_copies() {
+        write_behind.flush();
+        cancel_dropped_issues();
+        long long books = 0, oversubscribed = 0, drift = 0;
+        {
+            ConnectionPool::Lease conn = read_conn();
+            StmtGuard st = conn.prepared("SELECT COUNT(*), "
+                                    "COUNT(CASE WHEN b.available_copies < 0 OR b.available_copies + IFNULL(i.n, 0) > b.total_copies "
+                                    "OR i.copies < i.n OR i.top > b.total_copies OR i.low < 1 THEN 1 END), "
+                                    "COUNT(CASE WHEN b.available_copies + IFNULL(i.n, 0) != b.total_copies THEN 1 END) "
+                                    "FROM books b LEFT JOIN (SELECT book_id, COUNT(*) AS n, COUNT(DISTINCT copy_no) AS copies, MAX(copy_no) AS top, "
+                                    "MIN(copy_no) AS low FROM issued GROUP BY book_id) i ON i.book_id = b.book_id;");
+            if (!st || sqlite3_step(st.get()) != SQLITE_ROW) return {false, 0, "Audit query failed."};
+            books = sqlite3_column_int64(st.get(), 0);
+            oversubscribed = sqlite3_column_int64(st.get(), 1);
+            drift = sqlite3_column_int64(st.get(), 2);
+        }
+        if (!lazy()) {
+            for (size_t slot = 0; slot < catalog.size(); slot++) {
+                auto loans = issues_by_book.find(catalog.ids[slot]);
+                long long on_loan = loans == issues_by_book.end() ? 0 : (long long)loans->second.size();
+                int available = catalog.available_copies[slot];
+                if (available < 0 || available + on_loan > catalog.total_copies[slot]) oversubscribed++;
+            }
+        }
+        string msg = "books=" + to_string(books) + " oversubscribed=" + to_string(oversubscribed) + " drift=" + to_string(drift);
+        return {oversubscribed == 0 && drift == 0, 0, msg};
+    }
+
+    // Rating rankings. Resident mode reads the first k entries of
+    // rating_index; lazy mode walks the matching SQL index. Neither sorts
+    // the catalog.
+    vector<int> top_rated_ids(size_t k, int min_count) {
+        if (!lazy()) return rating_index.top_rated(k, max(1, min_count));
+        vector<int> ids;
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared("SELECT book_id FROM books WHERE total_ratings >= ? "
+                                     "ORDER BY avg_rating DESC, total_ratings DESC, book_id LIMIT ?;");
+        if (!st) return ids;
+        sqlite3_bind_int(st.get(), 1, max(1, min_count));
+        sqlite3_bind_int64(st.get(), 2, (sqlite3_int64)k);
+        while (sqlite3_step(st.get()) == SQLITE_ROW) ids.push_back(sqlite3_column_int(st.get(), 0));
+        return ids;
+    }
+
+    vector<int> most_rated_ids(size_t k) {
+        if (!lazy()) return rating_index.most_rated(k);
+        vector<int> ids;
+        ConnectionPool::Lease conn = read_conn();
+        StmtGuard st = conn.prepared("SELECT book_id FROM books WHERE total_ratings > 0 ORDER BY total_ratings DESC, book_id LIMIT ?;");
+        if (!st) return ids;
+        sqlite3_bind_int64(st.get(), 1, (sqlite3_int64)k);
+        while (sqlite3_step(st.get()) == SQLITE_ROW) ids.push_back(sqlite3_column_int(st.get(), 0));
+        return ids;
+    }
+
+    // ----------------------
+    // History: one page of a user/book/date-range query at a time (see
+    // history_query.h). Closed loans older than a cutoff can be moved out of
+    // the hot table into yearly archive partitions, which queries still read.
+    // ----------------------
+    static const size_t HISTORY_PAGE_MAX = 1000;
+
+    // pooled: the caller holds only the shared state lock (see pooled_read_conn)
+    bool history_page(const HistoryQuery& q, HistoryCursor& cur, size_t limit, vector<HistoryRow>& rows, bool pooled = false) {
+        Metrics::Timer timer(metrics, Metrics::HISTORY);
+        write_behind.flush();   // queued issues and returns belong on the page
+        ConnectionPool::Lease conn = pooled ? pooled_read_conn() : read_conn();
+        if (!conn) return false;
+        return HistoryPager::fetch(conn, history_tables, q, cur, min(limit, HISTORY_PAGE_MAX), rows);
+    }
+
+    // Local midnight at the start of YYYY-MM-DD
+    static bool parseDate(const string& s, time_t& out) {
+        int y, m, d;
+        char tail;
+        if (sscanf(s.c_str(), "%d-%d-%d%c", &y, &m, &d, &tail) != 3 || m < 1 || m > 12 || d < 1 || d > 31) return false;
+        struct tm tmv = {};
+        tmv.tm_year = y - 1900;
+        tmv.tm_mon = m - 1;
+        tmv.tm_mday = d;
+        tmv.tm_isdst = -1;
+        out = mktime(&tmv);
+        return out != (time_t)-1;
+    }
+
+    // Move returned loans issued before cutoff into history_YYYY partitions
+    // (by UTC issue year). Loans still out stay in the hot table.
+    OpResult archive_history(time_t cutoff) {
+        vector<string> years;
+        {
+            StmtGuard st = prepared("SELECT DISTINCT strftime('%Y', issue_datetime, 'unixepoch') FROM history "
+                                    "WHERE issue_datetime < ? AND status != 'issued';");
+            if (!st) return {false, 0, "Archive failed."};
+            sqlite3_bind_int64(st.get(), 1, (sqlite3_int64)cutoff);
+            while (sqlite3_step(st.get()) == SQLITE_ROW) years.push_back(column_string(st.get(), 0));
+        }
+        if (years.empty()) return {true, 0, "Nothing to archive."};
+
+        // A bulk move with no log record: committed on its own, after any group
+        if (!flush_group_commit() || !exec_cached("BEGIN IMMEDIATE;")) return {false, 0, "Archive failed; please try again."};
+        bool ok = true;
+        for (const string& year : years) {
+            if (!ok) break;
+            string table = "history_" + year;
+            if (!HistoryPager::is_partition(table)) continue;   // dates outside 0000-9999
+            string ddl = "CREATE TABLE IF NOT EXISTS " + table + " (issue_id INTEGER PRIMARY KEY, book_id INTEGER, user_id INTEGER, "
+                         "title TEXT, author TEXT, issue_datetime INTEGER, return_datetime INTEGER, status TEXT);"
+                       + HistoryPager::index_sql(table);
+            ok = exec_sql(ddl.c_str());
+            if (ok) {
+                string move = "INSERT INTO " + table + " SELECT * FROM history WHERE issue_datetime < ? AND status != 'issued' "
+                              "AND strftime('%Y', issue_datetime, 'unixepoch') = ?;";
+                StmtGuard st = prepared(move.c_str());
+                if (st) {
+                    sqlite3_bind_int64(st.get(), 1, (sqlite3_int64)cutoff);
+                    sqlite3_bind_text(st.get(), 2, year.c_str(), -1, SQLITE_TRANSIENT);
+                }
+                ok = run_stmt(st);
+            }
+        }
+        int moved = 0;
+        if (ok) {
+            StmtGuard st = prepared("DELETE FROM history WHERE issue_datetime < ? AND status != 'issued' "
+                                    "AND strftime('%Y', issue_datetime, 'unixepoch') BETWEEN '0000' AND '9999';");
+            if (st) sqlite3_bind_int64(st.get(), 1, (sqlite3_int64)cutoff);
+            ok = run_stmt(st);
+            moved = ok ? sqlite3_changes(db) : 0;
+        }
+        if (!ok || !commit_transaction()) {
+            exec_cached("ROLLBACK;");
+            return {false, 0, "Archive failed; nothing was changed."};
+        }
+
+        StateLock lock(state_mutex);
+        load_history_partitions();
+        return {true, moved, "Archived " + to_string(moved) + " history records into " + to_string(years.size()) + " partition(s)."};
+    }
+
+    // ----------------------
+    // Circulation reports (see circulation_stats.h). The summary is brought
+    // up to date before each report, scanning history on as many pooled
+    // readers as are free and the machine has cores for.
+    // ----------------------
+    bool refresh_circulation(CirculationSummary::RefreshStats& stats, double& ms) {
+        auto t0 = chrono::steady_clock::now();
+        if (!flush_group_commit()) return false;   // readers must see every loan
+        vector<ConnectionPool::Lease> conns;
+        size_t want = max(1u, thread::hardware_concurrency());
+        while (conns.size() < want) {
+            ConnectionPool::Lease c = readers.try_acquire();
+            if (!c) break;
+            conns.push_back(move(c));
+        }
+        if (conns.empty()) conns.emplace_back(db, &stmts);
+        bool ok = circulation.refresh(conns, history_tables, stats);
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        if (!ok) circulation.clear();   // rebuild from scratch next time
+        return ok;
+    }
+
+    // The aggregates as of the last refresh_circulation()
+    const CirculationSummary& circulation_summary() const {
+        return circulation;
+    }
+
+    static string utcDay(int64_t day) {
+        time_t t = (time_t)(day * 86400);
+        char buf[32];
+        struct tm tmv;
+#ifdef _WIN32
+        gmtime_s(&tmv, &t);
+#else
+        gmtime_r(&t, &tmv);
+#endif
+        strftime(buf, sizeof(buf), "%Y-%m-%d", &tmv);
+        return string(buf);
+    }
+
+    // ----------------------
+    // Bulk import of books from a delimited file (format in book_import.h).
+    // Worker threads parse and validate chunks while this thread inserts the
+    // previous ones in file order, IMPORT_BATCH rows per transaction through
+    // one cached statement. Rows reach the catalog as their transaction
+    // commits; the search index is built once at the end, and so are the
+    // books table's secondary indexes for a file of IMPORT_REINDEX_BYTES
+    // or more.
+    // ----------------------
+    static const size_t IMPORT_BATCH = 50000;
+    static const size_t IMPORT_ERRORS_SHOWN = 10;
+    static const size_t IMPORT_REINDEX_BYTES = 4u << 20;   // ~100k rows
+
+    OpResult import_books(const string& path, ostream& out) {
+        ifstream in(path, ios::binary);
+        if (!in) return {false, 0, "Cannot open import file: " + path};
+        if (!flush_group_commit()) return {false, 0, "Import failed; could not commit pending operations."};
+
+        auto start = chrono::steady_clock::now();
+        in.seekg(0, ios::end);
+        bool reindex = in.tellg() >= (streamoff)IMPORT_REINDEX_BYTES;
+        in.seekg(0, ios::beg);
+        if (reindex && !exec_sql(DROP_BOOK_INDEXES_SQL)) reindex = false;
+        ChunkReader reader(in);
+        size_t workers = max(1u, thread::hardware_concurrency());
+        deque<future<ParsedChunk>> parsing;
+        char delim = ',';
+        size_t line_base = 0;   // lines before the chunk at the front of `parsing`
+        bool first = true, more = true;
+
+        auto launch_next = [&]() {
+            string text;
+            if (!reader.next(text)) { more = false; return; }
+            if (first) {
+                first = false;
+                delim = BookCsv::detect_delimiter(text);
+                size_t nl = text.find('\n');
+                if (BookCsv::is_header(text.substr(0, nl), delim)) {
+                    text.erase(0, nl == string::npos ? text.size() : nl + 1);
+                    line_base = 1;
+                }
+            }
+            parsing.push_back(async(launch::async, [t = std::move(text), delim]() { return BookCsv::parse(t, delim); }));
+        };
+        while (more && parsing.size() <= workers) launch_next();
+
+        size_t imported = 0, rejected = 0;
+        size_t first_slot = catalog.size();
+        bool ok = true;
+        while (ok && !parsing.empty()) {
+            ParsedChunk chunk = parsing.front().get();
+            parsing.pop_front();
+            if (more) launch_next();   // keep the pool busy while this chunk is inserted
+
+            for (auto& e : chunk.errors) {
+                if (rejected++ >= IMPORT_ERRORS_SHOWN) continue;
+                if (imported > 0) out << "\n";   // end the progress line
+                out << "Line " << line_base + e.first << ": " << e.second << "\n";
+            }
+            line_base += chunk.lines;
+
+            for (size_t from = 0; ok && from < chunk.rows.size(); from += IMPORT_BATCH) {
+                size_t to = min(chunk.rows.size(), from + IMPORT_BATCH);
+                ok = import_batch(chunk.rows, from, to);
+                if (!ok) break;
+                imported += to - from;
+                double secs = seconds_since(start);
+                out << "\rImported " << imported << " books (" << fixed << setprecision(0)
+                    << (secs > 0 ? imported / secs : 0.0) << " rows/sec)" << flush;
+            }
+        }
+        if (imported > 0) out << "\n";
+        // Rebuilt on failure too: the batches that committed stay imported
+        if (reindex && !exec_sql(BOOK_INDEXES_SQL)) notify("The books indexes could not be rebuilt; the next start rebuilds them.");
+
+        if (!lazy()) {
+            StateLock lock(state_mutex);
+            for (uint32_t slot = (uint32_t)first_slot; slot < catalog.size(); slot++) {
+                search_index.add(catalog.ids[slot], catalog.title(slot), catalog.author(slot));
+            }
+        }
+
+        double secs = seconds_since(start);
+        ostringstream msg;
+        msg << (ok ? "Imported " : "Import stopped after ") << imported << " books, rejected " << rejected
+            << " rows in " << fixed << setprecision(3) << secs * 1000.0 << " ms (" << setprecision(0)
+            << (secs > 0 ? imported / secs : 0.0) << " rows/sec)";
+        return {ok, (int)imported, msg.str()};
+    }
+
+    // Insert rows[from, to) in one transaction; mirror them in memory only once committed
+    bool import_batch(vector<ImportRow>& rows, size_t from, size_t to) {
+        if (!exec_cached("BEGIN IMMEDIATE;")) return false;
+        vector<int> ids;
+        ids.reserve(to - from);
+        bool ok = true;
+        {
+            StmtGuard st = prepared("INSERT INTO books (title, author, total_copies, available_copies) VALUES (?, ?, ?, ?);");
+            ok = (bool)st;
+            for (size_t i = from; ok && i < to; i++) {
+                const ImportRow& r = rows[i];
+                sqlite3_stmt* stmt = st.get();
+                sqlite3_bind_text(stmt, 1, r.title.c_str(), (int)r.title.size(), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 2, r.author.c_str(), (int)r.author.size(), SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 3, r.copies);
+                sqlite3_bind_int(stmt, 4, r.copies);
+                ok = st.run();
+                ids.push_back(get_last_insert_rowid());
+            }
+            if (!ok) notify(string("SQL error: ") + sqlite3_errmsg(db));
+        }
+        if (!ok || !commit_transaction()) {
+            exec_cached("ROLLBACK;");
+            return false;
+        }
+
+        if (!lazy()) {
+            StateLock lock(state_mutex);
+            catalog.reserve(catalog.size() + ids.size());
+            for (size_t i = from; i < to; i++) {
+                const ImportRow& r = rows[i];
+                catalog.upsert(ids[i - from], r.title, r.author, r.copies, r.copies, RatingTally());
+            }
+        }
+        return true;
+    }
+
+    // Snapshot of every table (format in snapshot.h), read on a pooled
+    // connection inside one read transaction
+    OpResult export_snapshot(const string& path) {
+        if (!flush_group_commit()) return {false, 0, "Export failed; could not commit pending operations."};
+        auto start = chrono::steady_clock::now();
+
+        ConnectionPool::Lease conn = read_conn();
+        Snapshot::Stats st;
+        string err;
+        vector<string> tables = {"books", "users", "issued"};
+        tables.insert(tables.end(), history_tables.begin(), history_tables.end());
+        tables.push_back("sqlite_sequence");
+        bool ok = Snapshot::write(conn.db(), tables, path, st, err);
+        if (!ok) return {false, 0, "Export failed: " + err};
+
+        ostringstream msg;
+        msg << "Exported " << st.rows << " rows from " << st.tables << " tables to " << path << " ("
+            << st.bytes / 1024 << " KiB) in " << fixed << setprecision(3) << seconds_since(start) * 1000.0 << " ms";
+        return {true, (int)st.rows, msg.str()};
+    }
+
+    // ----------------------
+    // Batch mode: one command per line, applied through the same operations
+    // as the menus, with commits grouped every config.batch_size commands.
+    //   add-book TITLE | AUTHOR | COPIES     remove-book BOOK_ID
+    //   add-user USER_ID | NAME              remove-user USER_ID
+    //   issue USER_ID BOOK_ID                return USER_ID [RATING] [BOOK_ID]
+    //   copies BOOK_ID                       import-books PATH
+    //   export PATH
+    //   top-rated [K] [MIN_RATINGS]          most-rated [K]
+    //   history recent|user ID|book ID|range FROM TO [LIMIT] [CURSOR]
+    //   archive-history DAYS                 audit
+    //   circulation summary|daily [DAYS]|titles [K]|authors [K] [MIN_RETURNS]
+    //   metrics                              save
+    // Arguments are split on '|' when the line has one, else on whitespace.
+    // Blank lines and lines starting with '#' are skipped.
+    // Returns the number of failed commands.
+    // ----------------------
+    static string trim(const string& s) {
+        size_t b = s.find_first_not_of(" \t\r");
+        if (b == string::npos) return "";
+        size_t e = s.find_last_not_of(" \t\r");
+        return s.substr(b, e - b + 1);
+    }
+
+    static vector<string> split_args(const string& rest) {
+        vector<string> args;
+        if (rest.find('|') != string::npos) {
+            stringstream ss(rest);
+            string field;
+            while (getline(ss, field, '|')) args.push_back(trim(field));
+        } else {
+            stringstream ss(rest);
+            string field;
+            while (ss >> field) args.push_back(field);
+        }
+        return args;
+    }
+
+    static bool parse_int(const string& s, int& out) {
+        if (s.empty()) return false;
+        char* end = nullptr;
+        long v = strtol(s.c_str(), &end, 10);
+        if (*end != '\0' || v < numeric_limits<int>::min() || v > numeric_limits<int>::max()) return false;
+        out = (int)v;
+        return true;
+    }
+
+    // progress: where import-books reports rejected lines and its progress
+    // (batch mode passes its output stream); nothing is shown without one
+    OpResult run_command(const string& cmd, const vector<string>& args, ostream* progress = nullptr) {
+        int a = 0, b = 0;
+        if (cmd == "add-book") {
+            if (args.size() != 3 || !parse_int(args[2], a)) return {false, 0, "usage: add-book TITLE | AUTHOR | COPIES", OpStatus::INVALID};
+            return add_book(args[0], args[1], a);
+        }
+        if (cmd == "remove-book") {
+            if (args.size() != 1 || !parse_int(args[0], a)) return {false, 0, "usage: remove-book BOOK_ID", OpStatus::INVALID};
+            return remove_book(a);
+        }
+        if (cmd == "add-user") {
+            if (args.size() != 2 || !parse_int(args[0], a)) return {false, 0, "usage: add-user USER_ID | NAME", OpStatus::INVALID};
+            return add_user(a, args[1]);
+        }
+        if (cmd == "remove-user") {
+            if (args.size() != 1 || !parse_int(args[0], a)) return {false, 0, "usage: remove-user USER_ID", OpStatus::INVALID};
+            return remove_user(a);
+        }
+        if (cmd == "issue") {
+            if (args.size() != 2 || !parse_int(args[0], a) || !parse_int(args[1], b)) return {false, 0, "usage: issue USER_ID BOOK_ID", OpStatus::INVALID};
+            return issue_book(a, b, time(0));
+        }
+        if (cmd == "return") {
+            int book_id = 0;
+            if (args.empty() || args.size() > 3 || !parse_int(args[0], a) || (args.size() >= 2 && !parse_int(args[1], b))
+                || (args.size() == 3 && (!parse_int(args[2], book_id) || book_id <= 0))) {
+                return {false, 0, "usage: return USER_ID [RATING] [BOOK_ID]", OpStatus::INVALID};
+            }
+            return return_book(a, b, time(0), book_id);
+        }
+        if (cmd == "copies") return copies_request(args);
+        if (cmd == "import-books") {
+            if (args.size() != 1) return {false, 0, "usage: import-books PATH", OpStatus::INVALID};
+            if (progress) return import_books(args[0], *progress);
+            ostream quiet(nullptr);
+            return import_books(args[0], quiet);
+        }
+        if (cmd == "export") {
+            if (args.size() != 1) return {false, 0, "usage: export PATH", OpStatus::INVALID};
+            return export_snapshot(args[0]);
+        }
+        if (cmd == "audit") return audit_copies();
+        if (cmd == "metrics") return {true, 0, metrics_json()};
+        if (cmd == "top-rated" || cmd == "most-rated") return rating_request(cmd, args);
+        if (cmd == "history") return history_request(args);
+        if (cmd == "circulation") return circulation_request(args);
+        if (cmd == "archive-history") {
+            if (args.size() != 1 || !parse_int(args[0], a) || a < 0) return {false, 0, "usage: archive-history DAYS", OpStatus::INVALID};
+            return archive_history(time(0) - (time_t)a * 24 * 60 * 60);
+        }
+        if (cmd == "save") {
+            int rows = save_all();
+            if (rows < 0) return {false, 0, "Save failed; changes kept for the next save."};
+            return {true, 0, "Saved all (" + to_string(rows) + " changed rows)."};
+        }
+        return {false, 0, "Unknown command: " + cmd, OpStatus::INVALID};
+    }
+
+    // ----------------------
+    // Server requests (LineServer protocol): one command per line, one reply
+    // line starting with OK or ERR. Accepts the batch commands except
+    // import-books/export, plus the read-only requests
+    //   search QUERY      -> OK n<TAB>id|title|author|available ...
+    //   status USER_ID    book BOOK_ID    copies BOOK_ID    info    ping
+    //   top-rated [K] [MIN_RATINGS]    most-rated [K]
+    //   history recent|user ID|book ID|range FROM TO [LIMIT] [CURSOR]
+    // An issue claims its copy before taking the writer (issue_request).
+    // ----------------------
+    static string field(string_view v) {
+        string out(v);
+        for (char& c : out) if (c == '\t' || c == '|' || c == '\n') c = ' ';
+        return out;
+    }
+
+    string book_line(const Book& b) {
+        return to_string(b.book_id()) + "|" + field(b.title) + "|" + field(b.author) + "|" + to_string(b.availableCopies);
+    }
+
+    // top-rated [K] [MIN_RATINGS] | most-rated [K]
+    //   -> OK n<TAB>id|title|author|average|count|1-5 star counts ...
+    OpResult rating_request(const string& cmd, const vector<string>& args) {
+        int k = 10, min_count = 1;
+        bool top = cmd == "top-rated";
+        if (args.size() > (top ? 2u : 1u) || (args.size() > 0 && !parse_int(args[0], k)) || (args.size() > 1 && !parse_int(args[1], min_count)) || k <= 0) {
+            return {false, 0, top ? "usage: top-rated [K] [MIN_RATINGS]" : "usage: most-rated [K]", OpStatus::INVALID};
+        }
+        vector<int> ids = top ? top_rated_ids((size_t)k, min_count) : most_rated_ids((size_t)k);
+        string msg = to_string(ids.size());
+        Book b;
+        char avg[32];
+        for (int id : ids) {
+            if (!get_book(id, b)) continue;
+            snprintf(avg, sizeof(avg), "%.2f", b.ratings.average());
+            msg += "\t" + to_string(id) + "|" + field(b.title) + "|" + field(b.author) + "|" + avg + "|" + to_string(b.ratings.count) + "|";
+            for (size_t s = 0; s < 5; s++) msg += (s ? "/" : "") + to_string(b.ratings.stars[s]);
+        }
+        return {true, 0, msg};
+    }
+
+    // copies BOOK_ID
+    //   -> OK n<TAB>barcode|on-shelf|-|- or barcode|on-loan|user_id|due ...
+    OpResult copies_request(const vector<string>& args) {
+        int id = 0;
+        if (args.size() != 1 || !parse_int(args[0], id)) return {false, 0, "usage: copies BOOK_ID", OpStatus::INVALID};
+        vector<CopyStatus> list;
+        if (!copy_status(id, list)) return {false, 0, "Book not found.", OpStatus::NOT_FOUND};
+        string msg = to_string(list.size());
+        for (const CopyStatus& c : list) {
+            msg += "\t" + barcode(id, c.copy_no) + (c.issue_id ? "|on-loan|" + to_string(c.user_id) + "|" + epochToStr(c.due) : "|on-shelf|-|-");
+        }
+        return {true, (int)list.size(), msg};
+    }
+
+    // history recent|user ID|book ID|range FROM TO [LIMIT] [CURSOR]
+    //   -> OK n next=CURSOR<TAB>issue_id|book_id|user_id|title|author|issued|returned|status ...
+    // Pass CURSOR back for the following page; "next=-" means there is none.
+    OpResult history_request(const vector<string>& args, bool pooled = false) {
+        const char* usage = "usage: history recent|user ID|book ID|range FROM TO [LIMIT] [CURSOR]";
+        HistoryQuery q;
+        size_t at = 1;
+        if (args.empty()) return {false, 0, usage, OpStatus::INVALID};
+        if (args[0] == "user" || args[0] == "book") {
+            q.by = args[0] == "user" ? HistoryQuery::USER : HistoryQuery::BOOK;
+            if (args.size() < 2 || !parse_int(args[1], q.id)) return {false, 0, usage, OpStatus::INVALID};
+            at = 2;
+        } else if (args[0] == "range") {
+            time_t from, to;
+            if (args.size() < 3 || !parseDate(args[1], from) || !parseDate(args[2], to)) return {false, 0, usage, OpStatus::INVALID};
+            q.from = from;
+            q.to = to;
+            at = 3;
+        } else if (args[0] != "recent") {
+            return {false, 0, usage, OpStatus::INVALID};
+        }
+        int limit = 20;
+        HistoryCursor cur;
+        if (args.size() > at + 2 || (args.size() > at && (!parse_int(args[at], limit) || limit <= 0))
+            || (args.size() > at + 1 && !HistoryCursor::decode(args[at + 1], cur))) {
+            return {false, 0, usage, OpStatus::INVALID};
+        }
+
+        vector<HistoryRow> rows;
+        if (!history_page(q, cur, (size_t)limit, rows, pooled)) return {false, 0, "History query failed."};
+        string msg = to_string(rows.size()) + " next=" + cur.encode();
+        for (auto& r : rows) {
+            msg += "\t" + to_string(r.issue_id) + "|" + to_string(r.book_id) + "|" + to_string(r.user_id) + "|" + field(r.title) + "|"
+                 + field(r.author) + "|" + epochToStr((time_t)r.issued) + "|" + epochToStr((time_t)r.returned) + "|" + r.status;
+        }
+        return {true, (int)rows.size(), msg};
+    }
+
+    // circulation summary|daily [DAYS]|titles [K]|authors [K] [MIN_RETURNS]
+    //   summary -> OK loans=N returned=N out=N avg_days=D
+    //   daily   -> OK n<TAB>YYYY-MM-DD|loans ...   (UTC days)
+    //   titles  -> OK n<TAB>title|loans ...
+    //   authors -> OK n<TAB>author|overdue|returned ...   (highest overdue rate first)
+    OpResult circulation_request(const vector<string>& args) {
+        const char* usage = "usage: circulation summary|daily [DAYS]|titles [K]|authors [K] [MIN_RETURNS]";
+        string what = args.empty() ? "summary" : args[0];
+        int k = what == "daily" ? 14 : 10, min_returns = 5;
+        bool authors = what == "authors";
+        if ((what != "summary" && what != "daily" && what != "titles" && !authors) || args.size() > (authors ? 3u : what == "summary" ? 1u : 2u)
+            || (args.size() > 1 && (!parse_int(args[1], k) || k <= 0)) || (args.size() > 2 && !parse_int(args[2], min_returns))) {
+            return {false, 0, usage, OpStatus::INVALID};
+        }
+        CirculationSummary::RefreshStats stats;
+        double ms = 0;
+        if (!refresh_circulation(stats, ms)) return {false, 0, "Circulation reports failed."};
+
+        if (what == "summary") {
+            char avg[32];
+            snprintf(avg, sizeof(avg), "%.2f", circulation.average_loan_days());
+            return {true, 0, "loans=" + to_string(circulation.loans()) + " returned=" + to_string(circulation.returned())
+                                 + " out=" + to_string(circulation.still_out()) + " avg_days=" + avg};
+        }
+        string msg;
+        size_t n = 0;
+        if (what == "daily") {
+            for (auto& d : circulation.daily((size_t)k)) { msg += "\t" + utcDay(d.first) + "|" + to_string(d.second); n++; }
+        } else if (what == "titles") {
+            for (auto& t : circulation.top_titles((size_t)k)) { msg += "\t" + field(t.first) + "|" + to_string(t.second); n++; }
+        } else {
+            for (auto& a : circulation.overdue_by_author((size_t)k, min_returns)) {
+                msg += "\t" + field(a.first) + "|" + to_string(a.second.overdue) + "|" + to_string(a.second.closed);
+                n++;
+            }
+        }
+        return {true, (int)n, to_string(n) + msg};
+    }
+
+    // shared: the caller holds only the shared state lock, not writer_mutex
+    OpResult read_request(const string& cmd, const string& rest, bool shared = false) {
+        int id = 0;
+        if (cmd == "ping") return {true, 0, "pong"};
+        if (cmd == "info") {
+            return {true, 0, "books=" + to_string(book_count()) + " users=" + to_string(user_count()) + " loans=" + to_string(issued.size())};
+        }
+        if (cmd == "book") {
+            Book b;
+            if (!parse_int(trim(rest), id) || !get_book(id, b)) return {false, 0, "Book not found.", OpStatus::NOT_FOUND};
+            return {true, id, book_line(b)};
+        }
+        if (cmd == "status") {
+            User u;
+            if (!parse_int(trim(rest), id) || !get_user(id, u)) return {false, 0, "User not found.", OpStatus::NOT_FOUND};
+            time_t now = time(0);
+            string msg = "user " + to_string(id) + " " + field(u.name);
+            vector<IssuedRecord> loans = loans_of(id);
+            for (const IssuedRecord& rec : loans) {
+                msg += " | ISSUED issue " + to_string(rec.issue_id()) + " book " + to_string(rec.book_id) + " due " + epochToStr(rec.dueDatetime);
+            }
+            if (loans.empty() && u.isDefaulter && now < u.penaltyEnd) {
+                msg += " | DEFAULTER until " + epochToStr(u.penaltyEnd);
+            } else if (loans.empty()) {
+                msg += " | ACTIVE";
+            }
+            return {true, id, msg};
+        }
+        if (cmd == "copies") return copies_request(split_args(rest));
+        if (cmd == "top-rated" || cmd == "most-rated") return rating_request(cmd, split_args(rest));
+        if (cmd == "history") return history_request(split_args(rest), shared);
+        // search
+        vector<int> ids = search_ids(rest);
+        string msg = to_string(ids.size());
+        Book b;
+        for (int bid : ids) if (get_book(bid, b)) msg += "\t" + book_line(b);
+        return {true, 0, msg};
+    }
+
+    // Server issue: claim the copy before queueing for the writer, so when a
+    // book runs out the remaining requests for it are turned away in
+    // parallel instead of each waiting its turn to find out
+    OpResult issue_request(const string& rest) {
+        vector<string> args = split_args(rest);
+        int uid = 0, book_id = 0;
+        if (args.size() != 2 || !parse_int(args[0], uid) || !parse_int(args[1], book_id)) return {false, 0, "usage: issue USER_ID BOOK_ID", OpStatus::INVALID};
+        if (!reserve_copy(book_id)) {
+            shared_lock<shared_mutex> lock(state_mutex);
+            return has_book(book_id) ? OpResult(false, 0, "No available copies.", OpStatus::UNAVAILABLE)
+                                     : OpResult(false, 0, "Book not found.", OpStatus::NOT_FOUND);
+        }
+        lock_guard<mutex> lock(writer_mutex);
+        return issue_book(uid, book_id, time(0), true);
+    }
+
+    string handle_request(const string& line) {
+        Metrics::Timer timer(metrics, Metrics::REQUEST);
+        string text = trim(line);
+        size_t sp = text.find_first_of(" \t");
+        string cmd = text.substr(0, sp);
+        string rest = sp == string::npos ? "" : text.substr(sp + 1);
+
+        OpResult r;
+        bool read = cmd == "search" || cmd == "status" || cmd == "book" || cmd == "copies" || cmd == "info" || cmd == "ping"
+                 || cmd == "top-rated" || cmd == "most-rated" || cmd == "history";
+        // History is SQL: it runs alongside writes on a pooled reader, but
+        // an open group is only visible on the writer's own connection
+        bool shared = read && !lazy() && (cmd != "history" || (!config.group_commit && readers.size() > 0));
+        if (cmd.empty()) {
+            r = {false, 0, "empty request", OpStatus::INVALID};
+        } else if (cmd == "import-books" || cmd == "export") {
+            r = {false, 0, "not available over the network: " + cmd, OpStatus::INVALID};
+        } else if (shared) {
+            shared_lock<shared_mutex> lock(state_mutex);
+            r = read_request(cmd, rest, true);
+        } else if (cmd == "issue" && !lazy()) {
+            r = issue_request(rest);
+        } else {
+            // Writes, every lazy-mode request (cache lookups reorder the LRU)
+            // and history while group commit is on
+            lock_guard<mutex> lock(writer_mutex);
+            r = read ? read_request(cmd, rest) : run_command(cmd, split_args(rest));
+        }
+        return (r.ok ? "OK " : "ERR ") + r.message;
+    }
+
+    // Periodic server housekeeping: commit a group that has waited long
+    // enough, or retry one that failed to commit, and cancel the loans the
+    // write-behind queue could not write
+    void tick() {
+        lock_guard<mutex> lock(writer_mutex);
+        if (group_pending() && (!group_open || group_commit_due())) flush_group_commit();
+        cancel_dropped_issues();
+        dump_metrics_if_requested();
+    }
+
+    int run_batch(istream& in, ostream& out) {
+        // Batch commits by count only; restore the interactive settings
+        // afterwards. Write-behind already batches its writes.
+        LibraryConfig saved = config;
+        flush_group_commit();
+        if (!write_behind.active()) {
+            config.group_commit = true;
+            config.group_commit_ops = max(1, config.batch_size);
+            config.group_commit_ms = numeric_limits<int>::max();
+        }
+
+        auto start = chrono::steady_clock::now();
+        size_t lineNo = 0, commands = 0, failed = 0;
+        string line;
+        while (getline(in, line)) {
+            lineNo++;
+            string text = trim(line);
+            if (text.empty() || text[0] == '#') continue;
+
+            size_t sp = text.find_first_of(" \t");
+            string cmd = text.substr(0, sp);
+            vector<string> args = split_args(sp == string::npos ? "" : text.substr(sp + 1));
+            OpResult r = run_command(cmd, args, &out);
+            dump_metrics_if_requested();
+            commands++;
+            if (!r.ok) failed++;
+            out << lineNo << (r.ok ? " OK " : " ERR ") << cmd << ": " << r.message << "\n";
+        }
+        if (!flush_group_commit()) out << "Final commit failed.\n";
+        config.group_commit = saved.group_commit;
+        config.group_commit_ops = saved.group_commit_ops;
+        config.group_commit_ms = saved.group_commit_ms;
+
+        double secs = seconds_since(start);
+        out << "Batch: " << commands << " commands (" << commands - failed << " ok, " << failed << " failed) in "
+            << fixed << setprecision(3) << secs * 1000.0 << " ms (" << setprecision(0)
+            << (secs > 0 ? commands / secs : 0.0) << " ops/sec)\n";
+        return (int)failed;
+    }
+};
+
+// ----------------------
+// LibraryConsole: the interactive menus, a thin client of Library. It
+// prompts on cin, calls the engine's typed operations and read API, and
+// prints what comes back on cout; it keeps no library state of its own.
+// ----------------------
+class LibraryConsole {
+private:
+    Library& lib;
+    int page_rows;   // listings pause every N rows (0 = no paging)
+
+public:
+    explicit LibraryConsole(Library& l, int pageRows = 0) : lib(l), page_rows(pageRows) {
+
     }
 
     // Helper functions
@@ -386,203 +3120,259 @@ public:
             clearInputLine();
             cout << "Invalid choice! Please enter a number: ";
         }
+        lib.dump_metrics_if_requested();
         return ch;
     }
 
-    string epochToStr(time_t t) {
-        if (t == 0) return "-";
-        char buf[64];
-        struct tm* tmv = localtime(&t);
-        strftime(buf, sizeof(buf), "%Y-%m-%d", tmv);
-        return string(buf);
-    }
-
-    bool user_has_active_issue(int userId) const {
-        for (auto& p : issued) {
-            if (p.second.user_id == userId) return true;
-        }
-        return false;
-    }
-
-    // Book operations
     void addBook() {
         clearInputLine();
         string title, author;
         cout << "Enter Title: "; getline(cin, title);
         cout << "Enter Author: "; getline(cin, author);
         int total = readInt("Enter total copies: ");
-        if (total <= 0) { cout << "Invalid number.\n"; return; }
-
-        const char* sql = "INSERT INTO books (title, author, total_copies, available_copies) VALUES (?, ?, ?, ?);";
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_text(stmt, 1, title.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, author.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(stmt, 3, total);
-            sqlite3_bind_int(stmt, 4, total);
-            sqlite3_step(stmt);
-            int book_id = get_last_insert_rowid();
-            sqlite3_finalize(stmt);
-
-            books[book_id] = Book(book_id, title, author, total, total);
-            cout << "Book added successfully. ID: " << book_id << "\n";
-        }
+        cout << lib.add_book(title, author, total).message << "\n";
     }
 
     void removeBook() {
         int book_id = readInt("Enter Book ID to remove: ");
-        if (books.find(book_id) == books.end()) {
-            cout << "Book not found.\n";
+        cout << lib.remove_book(book_id).message << "\n";
+    }
+
+    // ----------------------
+    // Book and user listings go through TableWriter (table_writer.h). The
+    // stream* versions are the earlier iostream renderers, kept as the
+    // reference for --render-bench; both produce identical text.
+    // ----------------------
+    static const int BOOK_RULE = 90;
+    static const int USER_RULE = 91;
+
+    void writeBookTable(TableWriter& w) {
+        w.text("ID", 6).text("Title", 30).text("Author", 20).text("Total", 10).text("Available", 12).text("Rating", 10)
+         .text("Ratings Count").end_row();
+        w.text(string(BOOK_RULE, '-')).end_row();
+        lib.visit_books([&](const Book& b) {
+            if (!w.row()) return false;
+            w.num(b.book_id(), 6).text(b.title, 30).text(b.author, 20).num(b.totalCopies, 10).num(b.availableCopies, 12)
+             .fixed1(b.ratings.average(), 10).num(b.ratings.count).end_row();
+            return true;
+        });
+    }
+
+    void streamBookTable(ostream& out) {
+        out << left << setw(6) << "ID"
+            << setw(30) << "Title"
+            << setw(20) << "Author"
+            << setw(10) << "Total"
+            << setw(12) << "Available"
+            << setw(10) << "Rating"
+            << "Ratings Count"
+            << "\n";
+        out << string(BOOK_RULE, '-') << "\n";
+        lib.visit_books([&](const Book& b) {
+            out << left
+                << setw(6) << b.book_id()
+                << setw(30) << b.title
+                << setw(20) << b.author
+                << setw(10) << b.totalCopies
+                << setw(12) << b.availableCopies
+                << setw(10) << fixed << setprecision(1) << b.ratings.average()
+                << b.ratings.count
+                << "\n";
+        });
+    }
+
+    // Prompt between pages of a listing; false stops it
+    bool morePages(size_t shown) {
+        cout << "-- " << shown << " shown; Enter for more, q to stop: " << flush;
+        string line;
+        return getline(cin, line) && Library::trim(line).empty();
+    }
+
+    // A writer on cout, paged by --page-rows
+    TableWriter listingWriter() {
+        if (page_rows <= 0) return TableWriter(cout);
+        clearInputLine();
+        return TableWriter(cout, (size_t)page_rows, [this](size_t shown) { return morePages(shown); });
+    }
+
+    void viewBooks() {
+        if (lib.total_books() == 0) {
+            cout << "No books available.\n";
             return;
         }
+        cout << "\n------------------- BOOK LIST -------------------\n";
+        TableWriter w = listingWriter();
+        writeBookTable(w);
+    }
 
-        // Check if any active issues
-        for (auto& p : issued) {
-            if (p.second.book_id == book_id) {
-                cout << "Cannot remove; active issued copies exist.\n";
-                return;
-            }
-        }
+    void printSearchResults(const string& query) {
+        auto start = chrono::steady_clock::now();
+        vector<int> ids = lib.search_ids(query);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-        char sql[256];
-        sprintf(sql, "DELETE FROM books WHERE book_id = %d;", book_id);
-        if (exec_sql(sql)) {
-            books.erase(book_id);
-            cout << "Book removed.\n";
+        if (ids.empty()) {
+            cout << "No matching books.\n";
+            return;
         }
+        for (int id : ids) {
+            Book b;
+            if (lib.find_book(id, b)) printEntity(b);
+        }
+        cout << ids.size() << " result(s) in " << fixed << setprecision(3) << ms << " ms\n";
     }
-    void viewBooks() {
-    if (books.empty()) {
-        cout << "No books available.\n";
-        return;
-    }
-
-    cout << "\n------------------- BOOK LIST -------------------\n";
-    cout << left << setw(6) << "ID"
-         << setw(30) << "Title"
-         << setw(20) << "Author"
-         << setw(10) << "Total"
-         << setw(12) << "Available"
-         << setw(10) << "Rating"
-         << "Ratings Count"
-         << "\n";
-
-    cout << string(90, '-') << "\n";
-
-    for (auto& p : books) {
-        const Book& b = p.second;
-
-        cout << left
-             << setw(6) << b.book_id()
-             << setw(30) << b.title
-             << setw(20) << b.author
-             << setw(10) << b.totalCopies
-             << setw(12) << b.availableCopies
-             << setw(10) << fixed << setprecision(1) << b.avg_rating
-             << b.total_ratings
-             << "\n";
+
+    void searchBooks() {
+        clearInputLine();
+        string query;
+        cout << "Search title/author: "; getline(cin, query);
+        printSearchResults(query);
     }
-}
-// User operations
+
     void addUser() {
         int id = readInt("Enter User ID: ");
-        if (users.count(id)) { cout << "User exists.\n"; return; }
+        if (lib.user_exists(id)) { cout << "User exists.\n"; return; }
 
         clearInputLine();
         string name; cout << "Enter Name: "; getline(cin, name);
-
-        users[id] = User(id, name);
-        char sql[512];
-        sprintf(sql, "INSERT INTO users (user_id, name) VALUES (%d, '%s');", id, name.c_str());
-        exec_sql(sql);
-        cout << "User added.\n";
+        cout << lib.add_user(id, name).message << "\n";
     }
+
     void removeUser() {
         int id = readInt("Enter User ID to remove: ");
-        if (!users.count(id)) { cout << "User not found.\n"; return; }
-
-        if (user_has_active_issue(id)) {
-            cout << "Cannot remove; user has active issued book.\n";
-            return;
-        }
-
-        char sql[256];
-        sprintf(sql, "DELETE FROM users WHERE user_id = %d;", id);
-        if (exec_sql(sql)) {
-            users.erase(id);
-            cout << "User removed.\n";
-        }
+        cout << lib.remove_user(id).message << "\n";
     }
-    void viewUsers() {
-    if (users.empty()) {
-        cout << "No users.\n";
-        return;
+
+    void writeUserTable(TableWriter& w, time_t now) {
+        const string rule(USER_RULE, '-');
+        w.text(rule).end_row();
+        w.text("ID", 8).text("Name", 20).text("Status", 12).text("BookID", 10).text("Issue Date", 15).text("Due Date", 15)
+         .text("Penalty End", 15).end_row();
+        w.text(rule).end_row();
+        IssuedRecord rec;
+        lib.visit_users([&](const User& u) {
+            if (!w.row()) return false;
+            bool defaulter = u.isDefaulter && now < u.penaltyEnd;
+            bool onLoan = lib.loan_of(u.user_id(), rec);
+            size_t held = onLoan ? lib.loan_count(u.user_id()) : 0;
+            w.num(u.user_id(), 8).text(u.name, 20);
+            if (held > 1) w.text("ISSUED(" + to_string(held) + ")", 12);   // the loan due first is shown
+            else w.text(onLoan ? "ISSUED" : defaulter ? "DEFAULTER" : "ACTIVE", 12);
+            if (onLoan) w.num(rec.book_id, 10).date(rec.issueDatetime, 15).date(rec.dueDatetime, 15);
+            else w.text("-", 10).text("-", 15).text("-", 15);
+            w.date(defaulter ? u.penaltyEnd : 0, 15).end_row();
+            return true;
+        });
+        if (!w.was_stopped()) w.text(rule).end_row();
     }
 
-    time_t now = time(0);
+    void streamUserTable(ostream& out, time_t now) {
+        out << "-------------------------------------------------------------------------------------------\n";
+        out << left << setw(8)  << "ID"
+            << setw(20) << "Name"
+            << setw(12) << "Status"
+            << setw(10) << "BookID"
+            << setw(15) << "Issue Date"
+            << setw(15) << "Due Date"
+            << setw(15) << "Penalty End"
+            << "\n-------------------------------------------------------------------------------------------\n";
+
+        lib.visit_users([&](const User& u) {
+            string status = "ACTIVE";
+            int issuedBookId = -1;
+            string issueStr = "-", dueStr = "-", penaltyStr = "-";
+
+            if (u.isDefaulter && now < u.penaltyEnd) {
+                status = "DEFAULTER";
+                penaltyStr = Library::epochToStr(u.penaltyEnd);
+            }
+            IssuedRecord rec;
+            if (lib.loan_of(u.user_id(), rec)) {
+                size_t held = lib.loan_count(u.user_id());
+                status = held > 1 ? "ISSUED(" + to_string(held) + ")" : "ISSUED";
+                issuedBookId = rec.book_id;
+                issueStr = Library::epochToStr(rec.issueDatetime);
+                dueStr = Library::epochToStr(rec.dueDatetime);
+            }
 
-    cout << "\n-------------------------------------------------------------------------------------------\n";
-    cout << left << setw(8)  << "ID"
-         << setw(20) << "Name"
-         << setw(12) << "Status"
-         << setw(10) << "BookID"
-         << setw(15) << "Issue Date"
-         << setw(15) << "Due Date"
-         << setw(15) << "Penalty End"
-         << "\n-------------------------------------------------------------------------------------------\n";
+            out << left << setw(8)  << u.user_id()
+                << setw(20) << u.name
+                << setw(12) << status
+                << setw(10) << (issuedBookId == -1 ? "-" : to_string(issuedBookId))
+                << setw(15) << issueStr
+                << setw(15) << dueStr
+                << setw(15) << penaltyStr
+                << "\n";
+        });
+        out << "-------------------------------------------------------------------------------------------\n";
+    }
 
-    for (auto &p : users) {
-        const User &u = p.second;
+    void viewUsers() {
+        if (lib.total_users() == 0) {
+            cout << "No users.\n";
+            return;
+        }
+        time_t now = time(0);
+        lib.apply_deadlines(now);
+        cout << "\n";
+        TableWriter w = listingWriter();
+        writeUserTable(w, now);
+    }
 
-        string status = "ACTIVE";
-        int issuedBookId = -1;
-        time_t issueTime = 0, dueTime = 0;
-        string issueStr = "-", dueStr = "-", penaltyStr = "-";
+    // --render-bench: both renderers into a discarding stream, best of 3,
+    // then one run of each into memory to check they agree
+    struct DiscardBuf : streambuf {
+        int overflow(int c) override { return traits_type::not_eof(c); }
+        streamsize xsputn(const char*, streamsize n) override { return n; }
+    };
 
-        // Check defaulter
-        if (u.isDefaulter && now < u.penaltyEnd) {
-            status = "DEFAULTER";
-            penaltyStr = epochToStr(u.penaltyEnd);
-        }
-
-        // Check issued
-        for (auto &q : issued) {
-            if (q.second.user_id == u.user_id()) {
-                status = "ISSUED";
-                issuedBookId = q.second.book_id;
-                issueTime = q.second.issueDatetime;
-                dueTime = q.second.dueDatetime;
-                issueStr = epochToStr(issueTime);
-                dueStr = epochToStr(dueTime);
-                break;
+    void renderBenchmark(ostream& report) {
+        DiscardBuf sink;
+        ostream out(&sink);
+        time_t now = time(0);
+        lib.apply_deadlines(now);
+        auto best = [](const function<void()>& fn) {
+            double secs = numeric_limits<double>::max();
+            for (int i = 0; i < 3; i++) {
+                auto start = chrono::steady_clock::now();
+                fn();
+                secs = min(secs, chrono::duration<double>(chrono::steady_clock::now() - start).count());
             }
+            return secs;
+        };
+        auto line = [&](const char* what, size_t rows, double stream_s, double writer_s) {
+            report << "  " << left << setw(6) << what << right << rows << " rows | iostream " << setprecision(0)
+                   << (stream_s > 0 ? rows / stream_s : 0.0) << " rows/sec | TableWriter " << (writer_s > 0 ? rows / writer_s : 0.0)
+                   << " rows/sec | " << setprecision(1) << (writer_s > 0 ? stream_s / writer_s : 0.0) << "x\n";
+        };
+
+        report << fixed << "Render benchmark (best of 3, output discarded):\n";
+        line("books", lib.total_books(), best([&] { streamBookTable(out); }), best([&] { TableWriter w(out); writeBookTable(w); }));
+        line("users", lib.total_users(), best([&] { streamUserTable(out, now); }), best([&] { TableWriter w(out); writeUserTable(w, now); }));
+
+        ostringstream by_stream, by_writer;
+        streamBookTable(by_stream);
+        streamUserTable(by_stream, now);
+        {
+            TableWriter w(by_writer);
+            writeBookTable(w);
+            writeUserTable(w, now);
         }
-
-        cout << left << setw(8)  << u.user_id()
-             << setw(20) << u.name
-             << setw(12) << status
-             << setw(10) << (issuedBookId == -1 ? "-" : to_string(issuedBookId))
-             << setw(15) << issueStr
-             << setw(15) << dueStr
-             << setw(15) << penaltyStr
-             << "\n";
+        report << "Output identical: " << (by_stream.str() == by_writer.str() ? "yes" : "NO") << "\n";
+        report.unsetf(ios::fixed);
     }
 
-    cout << "-------------------------------------------------------------------------------------------\n";
-}
-// Issue/Return operations
     void user_request_issue() {
         int uid = readInt("Enter your User ID: ");
-        if (!users.count(uid)) {
+        bool lineConsumed = false;   // whether the rest of the numeric input line was read
+        if (!lib.user_exists(uid)) {
             cout << "User not found. Register? (1=Yes 2=No): ";
             int ch = readMenuChoice();
             if (ch == 1) {
                 clearInputLine();
                 string name; cout << "Enter Name: "; getline(cin, name);
-                users[uid] = User(uid, name);
-                char sql[512];
-                sprintf(sql, "INSERT INTO users (user_id, name) VALUES (%d, '%s');", uid, name.c_str());
-                exec_sql(sql);
+                lineConsumed = true;
+                OpResult r = lib.add_user(uid, name);
+                if (!r.ok) { cout << r.message << "\n"; return; }
                 cout << "Registered successfully.\n";
             } else {
                 cout << "Operation cancelled.\n";
@@ -590,229 +3380,317 @@ public:
             }
         }
 
-        User& u = users[uid];
-        time_t now = time(0);
-        if (u.isDefaulter && now < u.penaltyEnd) {
-            cout << "You are a defaulter until: " << epochToStr(u.penaltyEnd) << "\n";
-            return;
-        }
-
-        if (user_has_active_issue(uid)) {
-            cout << "You already have an active issued book.\n";
+        // Check eligibility before asking for a book
+        OpResult allowed = lib.can_borrow(uid, time(0));
+        if (!allowed.ok) {
+            cout << allowed.message << "\n";
             return;
         }
 
-        viewBooks();
+        // Look the book up by title/author instead of listing the whole catalog
+        if (!lineConsumed) clearInputLine();
+        string query;
+        cout << "Search title/author (Enter to skip): "; getline(cin, query);
+        if (!query.empty()) printSearchResults(query);
         int book_id = readInt("Enter Book ID to issue: ");
-        if (books.find(book_id) == books.end()) {
-            cout << "Book not found.\n";
+        cout << lib.issue_book(uid, book_id, time(0)).message << "\n";
+    }
+
+    void user_request_return() {
+        int uid = readInt("Enter your User ID: ");
+        if (!lib.user_exists(uid)) { cout << "User not found.\n"; return; }
+
+        vector<IssuedRecord> loans = lib.loans_of(uid);
+        if (loans.empty()) {
+            cout << "No active issued books.\n";
             return;
         }
+        IssuedRecord active = loans[0];
+        if (loans.size() > 1) {
+            for (const IssuedRecord& r : loans) {
+                cout << "Book ID: " << r.book_id << " | Copy: " << Library::barcode(r.book_id, r.copy_no)
+                     << " | Due: " << Library::epochToStr(r.dueDatetime) << "\n";
+            }
+            int book_id = readInt("Enter Book ID to return: ");
+            auto it = find_if(loans.begin(), loans.end(), [&](const IssuedRecord& r) { return r.book_id == book_id; });
+            if (it == loans.end()) {
+                cout << "No active loan of book " << book_id << ".\n";
+                return;
+            }
+            active = *it;
+        }
 
-        Book& b = books[book_id];
-        if (b.availableCopies <= 0) {
-            cout << "No available copies.\n";
-            return;
+        // Ask for a 1-5 star rating while the book is still in the catalog
+        int rating = 0;
+        if (lib.book_exists(active.book_id)) {
+            cout << "Rate the book (1 to 5 stars): ";
+            cin >> rating;
+
+            while (rating < 1 || rating > 5) {
+                cout << "Invalid rating! Enter a number between 1 and 5: ";
+                cin >> rating;
+            }
         }
 
-        // Issue book
-        b.availableCopies--;
-        time_t issueTime = now;
-        time_t dueTime = issueTime + (15LL * 24 * 60 * 60); // 15 days
+        cout << lib.return_book(uid, rating, time(0), active.book_id).message << "\n";
+    }
 
-        const char* sql_issue = "INSERT INTO issued (book_id, user_id, issue_datetime, due_datetime) VALUES (?, ?, ?, ?);";
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql_issue, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, book_id);
-            sqlite3_bind_int(stmt, 2, uid);
-            sqlite3_bind_int64(stmt, 3, (sqlite3_int64)issueTime);
-            sqlite3_bind_int64(stmt, 4, (sqlite3_int64)dueTime);
-            sqlite3_step(stmt);
-            int issue_id = get_last_insert_rowid();
-            sqlite3_finalize(stmt);
+    void user_check_status() {
+        int uid = readInt("Enter your User ID: ");
+        time_t now = time(0);
+        lib.apply_deadlines(now);
+        User u;
+        if (!lib.find_user(uid, u)) { cout << "User not found.\n"; return; }
 
-            issued[issue_id] = IssuedRecord(issue_id, book_id, uid, issueTime, dueTime);
+        vector<IssuedRecord> loans = lib.loans_of(uid);
+        bool active = loans.size() < (size_t)lib.loan_limit() && !(u.isDefaulter && now < u.penaltyEnd);
+        cout << "User " << uid << " (" << u.name << ") is " << (active ? "ACTIVE" : "DISABLED") << ".\n";
 
-            // Add to history
-            const char* sql_history = "INSERT INTO history (issue_id, book_id, user_id, title, author, issue_datetime, return_datetime, status) VALUES (?, ?, ?, ?, ?, ?, 0, 'issued');";
-            if (sqlite3_prepare_v2(db, sql_history, -1, &stmt, nullptr) == SQLITE_OK) {
-                sqlite3_bind_int(stmt, 1, issue_id);
-                sqlite3_bind_int(stmt, 2, book_id);
-                sqlite3_bind_int(stmt, 3, uid);
-                sqlite3_bind_text(stmt, 4, b.title.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 5, b.author.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_int64(stmt, 6, (sqlite3_int64)issueTime);
-                sqlite3_step(stmt);
-                sqlite3_finalize(stmt);
-            }
+        for (const IssuedRecord& rec : loans) {
+            cout << "Issued ID: " << rec.issue_id() << " | Book ID: " << rec.book_id << " | Issued: " << Library::epochToStr(rec.issueDatetime) 
+                 << " | Due: " << Library::epochToStr(rec.dueDatetime) << "\n";
+        }
 
-            // Update book
-            char sql_update[256];
-            sprintf(sql_update, "UPDATE books SET available_copies = %d WHERE book_id = %d;", b.availableCopies, book_id);
-            exec_sql(sql_update);
+        if (u.isDefaulter && now < u.penaltyEnd) {
+            cout << "Penalty until: " << Library::epochToStr(u.penaltyEnd) << "\n";
+        }
+    }
 
-            cout << "Issued successfully! Issue ID: " << issue_id << " | Due: " << epochToStr(dueTime) << "\n";
+    // Admin menu functions
+    void listDefaulters() {
+        vector<User> list = lib.defaulters(time(0));
+        if (list.empty()) {
+            cout << "No defaulters.\n";
+            return;
+        }
+        for (const User& u : list) {
+            cout << "ID: " << u.user_id() << " | " << u.name << " | Penalty ends: " << Library::epochToStr(u.penaltyEnd) << "\n";
+            for (const IssuedRecord& rec : lib.loans_of(u.user_id())) {
+                cout << "  Active: ID " << rec.issue_id() << " | Due: " << Library::epochToStr(rec.dueDatetime) << "\n";
+            }
         }
     }
-    void user_request_return() {
-    int uid = readInt("Enter your User ID: ");
-    if (!users.count(uid)) { cout << "User not found.\n"; return; }
 
-    int issue_id = -1;
-    for (auto& p : issued) {
-        if (p.second.user_id == uid) {
-            issue_id = p.first;
-            break;
+    void overdueNotices() {
+        Library::OverdueReport report = lib.take_overdue_notices(time(0));
+        for (const IssuedRecord& r : report.notices) {
+            cout << "Notice: User " << r.user_id << " | Issue ID " << r.issue_id()
+                 << " | Book ID " << r.book_id << " | Due: " << Library::epochToStr(r.dueDatetime) << "\n";
         }
+        if (report.notices.empty()) cout << "No new overdue loans.\n";
+        cout << "Currently overdue: " << report.overdue
+             << " | Penalties ending within 24h: " << report.penalties_ending << "\n";
     }
 
-    if (issue_id == -1) {
-        cout << "No active issued books.\n";
-        return;
+    void copyStatus() {
+        int book_id = readInt("Enter Book ID: ");
+        vector<Library::CopyStatus> list;
+        if (!lib.copy_status(book_id, list)) {
+            cout << "Book not found.\n";
+            return;
+        }
+        size_t out = 0;
+        for (const Library::CopyStatus& c : list) {
+            cout << "Copy " << Library::barcode(book_id, c.copy_no) << " | ";
+            if (c.issue_id) {
+                out++;
+                cout << "On loan to user " << c.user_id << " | Issue ID: " << c.issue_id << " | Due: " << Library::epochToStr(c.due) << "\n";
+            } else {
+                cout << "On shelf\n";
+            }
+        }
+        cout << list.size() << " copies, " << out << " on loan\n";
     }
 
-    IssuedRecord& rec = issued[issue_id];
-    time_t now = time(0);
+    void catalogSummary() {
+        Library::CatalogTotals t;
+        if (!lib.catalog_totals(t)) return;
+        cout << "Titles: " << t.titles << " | Copies: " << t.copies << " | Available: " << t.available
+             << " | On loan: " << t.copies - t.available << "\n";
+        cout << "Titles in stock: " << t.in_stock << " | Rated " << fixed << setprecision(1) << Library::TOP_RATING
+             << " or above: " << t.top_rated << "\n";
+    }
 
-    // Update book availability
-    if (books.count(rec.book_id)) {
-        Book& b = books[rec.book_id];
-        b.availableCopies++;
-        if (b.availableCopies > b.totalCopies) b.availableCopies = b.totalCopies;
+    void printCacheStats() {
+        Library::MemoryReport m = lib.memory_report();
+        if (!m.lazy) {
+            cout << "Resident mode: " << m.books << " books, " << m.users << " users, "
+                 << m.loans << " active loans in memory.\n";
+            cout << "Book catalog: " << m.catalog_bytes / 1024 << " KiB in columns, "
+                 << m.distinct_strings << " distinct titles/authors.\n";
+            return;
+        }
+        auto report = [](const char* name, const Library::CacheReport& c) {
+            size_t lookups = c.stats.hits + c.stats.misses;
+            cout << name << ": " << c.entries << " cached, " << c.bytes / 1024 << " / " << c.capacity / 1024 << " KiB | hits "
+                 << c.stats.hits << " | misses " << c.stats.misses << " | evictions " << c.stats.evictions << " | hit rate "
+                 << fixed << setprecision(1) << (lookups ? 100.0 * c.stats.hits / lookups : 0.0) << "%\n";
+        };
+        report("Books", m.book_cache);
+        report("Users", m.user_cache);
+    }
 
-        char sql_update[256];
-        sprintf(sql_update, "UPDATE books SET available_copies = %d WHERE book_id = %d;", b.availableCopies, rec.book_id);
-        exec_sql(sql_update);
+    void printLoadStats() const {
+        for (const Library::TableLoadStats& t : lib.load_stats) {
+            double rate = t.seconds > 0 ? t.rows / t.seconds : 0.0;
+            cout << "Loaded " << t.table << ": " << t.rows << " rows in " << fixed << setprecision(3)
+                 << t.seconds * 1000.0 << " ms (" << setprecision(0) << rate << " rows/sec)\n";
+        }
+    }
 
-        // --------------------------
-        // ⭐ ASK FOR RATING 1–5
-        // --------------------------
-        int rating;
-        cout << "Rate the book (1 to 5 stars): ";
-        cin >> rating;
+    // "1-5 stars: a/b/c/d/e"
+    static string star_breakdown(const RatingTally& r) {
+        string out = "1-5 stars: ";
+        for (size_t k = 0; k < 5; k++) out += (k ? "/" : "") + to_string(r.stars[k]);
+        return out;
+    }
 
-        while (rating < 1 || rating > 5) {
-            cout << "Invalid rating! Enter a number between 1 and 5: ";
-            cin >> rating;
+    void printRanking(const vector<int>& ids) {
+        if (ids.empty()) {
+            cout << "No rated books.\n";
+            return;
+        }
+        Book b;
+        for (int id : ids) {
+            if (!lib.find_book(id, b)) continue;
+            cout << "ID: " << b.book_id() << " | Title: " << b.title << " | Author: " << b.author
+                 << " | Rating: " << fixed << setprecision(2) << b.ratings.average() << " (" << b.ratings.count << ")"
+                 << " | " << star_breakdown(b.ratings) << "\n";
         }
+    }
 
-        // ⭐ Update rating logic
-        b.total_ratings++;
-        b.avg_rating = ((b.avg_rating * (b.total_ratings - 1)) + rating) / b.total_ratings;
-
-        // Save updated rating to DB
-        char sql_rating[256];
-        sprintf(sql_rating,
-                "UPDATE books SET avg_rating = %.2f, total_ratings = %d WHERE book_id = %d;",
-                b.avg_rating, b.total_ratings, rec.book_id);
-        exec_sql(sql_rating);
-    }
-
-    // Remove from issued
-    char sql_delete[256];
-    sprintf(sql_delete, "DELETE FROM issued WHERE issue_id = %d;", issue_id);
-    exec_sql(sql_delete);
-    issued.erase(issue_id);
-
-    // Update history
-    string status = "returned";
-    if (now > rec.dueDatetime) {
-        status = "defaulter";
-        users[uid].isDefaulter = true;
-        users[uid].penaltyEnd = now + (7LL * 24 * 60 * 60); // 7 days penalty
-        char sql_user[512];
-        sprintf(sql_user, "UPDATE users SET is_defaulter = 1, penalty_end = %ld WHERE user_id = %d;",
-                (long)users[uid].penaltyEnd, uid);
-        exec_sql(sql_user);
-        cout << "Overdue return! You are marked as defaulter. Penalty until: "
-             << epochToStr(users[uid].penaltyEnd) << "\n";
-    } else {
-        cout << "Book returned successfully. Thank you!\n";
-    }
-
-    char sql_history[512];
-    sprintf(sql_history,
-            "UPDATE history SET return_datetime = %ld, status = '%s' WHERE issue_id = %d;",
-            (long)now, status.c_str(), issue_id);
-    exec_sql(sql_history);
-}
-    void user_check_status() {
-        int uid = readInt("Enter your User ID: ");
-        if (!users.count(uid)) { cout << "User not found.\n"; return; }
+    void topRatedBooks() {
+        int k = readInt("How many books: ");
+        int min_count = readInt("Minimum number of ratings: ");
+        if (k <= 0) return;
+        cout << "\n--- Highest rated (at least " << max(1, min_count) << " ratings) ---\n";
+        printRanking(lib.top_rated_ids((size_t)k, min_count));
+        cout << "\n--- Most rated ---\n";
+        printRanking(lib.most_rated_ids((size_t)k));
+    }
 
-        User& u = users[uid];
-        time_t now = time(0);
-        bool active = !user_has_active_issue(uid) && !(u.isDefaulter && now < u.penaltyEnd);
-        cout << "User " << uid << " (" << u.name << ") is " << (active ? "ACTIVE" : "DISABLED") << ".\n";
+    void printHistoryRow(const HistoryRow& r) {
+        cout << "ID: " << r.issue_id << " | Book: " << r.book_id << " | Title: " << r.title << " | Author: " << r.author
+             << " | User: " << r.user_id << " | Issued: " << Library::epochToStr((time_t)r.issued)
+             << " | Returned: " << (r.returned == 0 ? "-" : Library::epochToStr((time_t)r.returned))
+             << " | Status: " << r.status << "\n";
+    }
 
-        for (auto& p : issued) {
-            if (p.second.user_id == uid) {
-                cout << "Issued ID: " << p.first << " | Issued: " << epochToStr(p.second.issueDatetime) 
-                     << " | Due: " << epochToStr(p.second.dueDatetime) << "\n";
+    // Print q page by page; Enter shows the next page, anything else stops
+    void browseHistory(const HistoryQuery& q, size_t page_size) {
+        HistoryCursor cur;
+        size_t shown = 0;
+        while (true) {
+            vector<HistoryRow> rows;
+            if (!lib.history_page(q, cur, page_size, rows)) {
+                cout << "History query failed.\n";
+                return;
             }
+            for (auto& r : rows) printHistoryRow(r);
+            shown += rows.size();
+            if (cur.done || rows.empty()) break;
+            cout << "-- " << shown << " shown; Enter for more, q to stop: ";
+            string line;
+            if (!getline(cin, line) || !Library::trim(line).empty()) break;
         }
+        if (shown == 0) cout << "No history records.\n";
+    }
 
-        if (u.isDefaulter && now < u.penaltyEnd) {
-            cout << "Penalty until: " << epochToStr(u.penaltyEnd) << "\n";
-        }
+    void viewHistoryLastN(int N) {
+        if (N <= 0) return;
+        clearInputLine();
+        browseHistory(HistoryQuery(), (size_t)N);
     }
 
-    // Admin menu functions
-    void listDefaulters() {
-        time_t now = time(0);
-        bool any = false;
-        for (auto& p : users) {
-            const User& u = p.second;
-            if (u.isDefaulter && now < u.penaltyEnd) {
-                any = true;
-                cout << "ID: " << u.user_id() << " | " << u.name << " | Penalty ends: " << epochToStr(u.penaltyEnd) << "\n";
-                for (auto& q : issued) {
-                    if (q.second.user_id == u.user_id()) {
-                        cout << "  Active: ID " << q.first << " | Due: " << epochToStr(q.second.dueDatetime) << "\n";
-                    }
-                }
+    void historySearch() {
+        cout << "1. By user\n2. By book\n3. By date range\n";
+        int how = readInt("Enter choice: ");
+        HistoryQuery q;
+        if (how == 1 || how == 2) {
+            q.by = how == 1 ? HistoryQuery::USER : HistoryQuery::BOOK;
+            q.id = readInt(how == 1 ? "Enter User ID: " : "Enter Book ID: ");
+            clearInputLine();
+        } else if (how == 3) {
+            clearInputLine();
+            string from, to;
+            time_t t;
+            cout << "From (YYYY-MM-DD, Enter for the beginning): "; getline(cin, from);
+            cout << "To, exclusive (YYYY-MM-DD, Enter for now): "; getline(cin, to);
+            from = Library::trim(from);
+            to = Library::trim(to);
+            if (!from.empty()) {
+                if (!Library::parseDate(from, t)) { cout << "Invalid date.\n"; return; }
+                q.from = t;
+            }
+            if (!to.empty()) {
+                if (!Library::parseDate(to, t)) { cout << "Invalid date.\n"; return; }
+                q.to = t;
             }
+        } else {
+            cout << "Invalid choice.\n";
+            return;
         }
-        if (!any) cout << "No defaulters.\n";
+        browseHistory(q, 20);
     }
 
-    void viewHistoryLastN(int N) {
-        if (N <= 0) return;
-        char sql[256];
-        sprintf(sql, "SELECT * FROM history ORDER BY issue_id DESC LIMIT %d;", N);
+    void archiveHistory() {
+        int days = readInt("Archive returned loans issued more than how many days ago: ");
+        if (days < 0) {
+            cout << "Invalid number of days.\n";
+            return;
+        }
+        cout << lib.archive_history(time(0) - (time_t)days * 24 * 60 * 60).message << "\n";
+    }
 
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
-                int issue_id = sqlite3_column_int(stmt, 0);
-                int book_id = sqlite3_column_int(stmt, 1);
-                int user_id = sqlite3_column_int(stmt, 2);
-                string title = (const char*)sqlite3_column_text(stmt, 3);
-                string author = (const char*)sqlite3_column_text(stmt, 4);
-                time_t issue = (time_t)sqlite3_column_int64(stmt, 5);
-                time_t ret = (time_t)sqlite3_column_int64(stmt, 6);
-                string status = (const char*)sqlite3_column_text(stmt, 7);
-
-                cout << "ID: " << issue_id << " | Title: " << title << " | Author: " << author 
-                     << " | User: " << user_id << " | Issued: " << epochToStr(issue)
-                     << " | Returned: " << (ret == 0 ? "-" : epochToStr(ret))
-                     << " | Status: " << status << "\n";
-            }
-            sqlite3_finalize(stmt);
+    static string percent(int64_t part, int64_t whole) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1f%%", whole > 0 ? 100.0 * (double)part / (double)whole : 0.0);
+        return string(buf);
+    }
+
+    void circulationReports() {
+        CirculationSummary::RefreshStats stats;
+        double ms = 0;
+        if (!lib.refresh_circulation(stats, ms)) {
+            cout << "Circulation reports failed.\n";
+            return;
+        }
+        const CirculationSummary& circulation = lib.circulation_summary();
+        cout << "\n--- Circulation: " << circulation.loans() << " loans, " << circulation.returned() << " returned, "
+             << circulation.still_out() << " still out ---\n";
+        cout << fixed << setprecision(1) << "Average loan: " << circulation.average_loan_days() << " days\n";
+        cout.unsetf(ios::fixed);
+
+        cout << "\nLoans per day (last 14 days with loans, UTC):\n";
+        for (auto& d : circulation.daily(14)) cout << "  " << Library::utcDay(d.first) << "  " << d.second << "\n";
+
+        cout << "\nMost borrowed titles:\n";
+        for (auto& t : circulation.top_titles(10)) cout << "  " << t.second << "  " << t.first << "\n";
+
+        cout << "\nHighest overdue rate by author (at least 5 returns):\n";
+        for (auto& a : circulation.overdue_by_author(10, 5)) {
+            cout << "  " << percent(a.second.overdue, a.second.closed) << "  " << a.first << " (" << a.second.overdue << " of "
+                 << a.second.closed << " late)\n";
         }
+
+        cout << fixed << setprecision(1) << "\n(" << (stats.full ? "Full scan: " : "Refreshed: ") << stats.rows << " rows"
+             << (stats.full ? "" : " new, " + to_string(stats.closed) + " returns settled") << " on " << stats.threads
+             << " thread(s) in " << ms << " ms)\n";
+        cout.unsetf(ios::fixed);
     }
 
     // Menus
     void admin_menu() {
         cout << "Enter admin password: ";
         string pass; cin >> pass;
-        if (pass != ADMIN_PASS) { cout << "Wrong password.\n"; return; }
+        if (!lib.check_admin_password(pass)) { cout << "Wrong password.\n"; return; }
 
         int choice;
         while (true) {
             cout << "\n--- ADMIN MENU ---\n";
             cout << "1. Add Book\n2. Remove Book\n3. View Books\n4. Add User\n5. Remove User\n6. View Users\n";
-            cout << "7. List Defaulters\n8. View History (last N)\n9. Save All\n0. Exit\n";
+            cout << "7. List Defaulters\n8. View History (last N)\n9. Save All\n10. Overdue Notices\n11. Search Books\n12. Cache Statistics\n13. Catalog Summary\n14. Export Snapshot\n15. Top Rated Books\n16. History Search\n17. Archive History\n18. Circulation Reports\n19. Metrics (JSON)\n20. Copy Status\n0. Exit\n";
+            lib.flush_group_commit();   // nothing stays uncommitted while the menu waits
             choice = readMenuChoice();
 
             switch (choice) {
@@ -828,7 +3706,29 @@ public:
                     viewHistoryLastN(N);
                     break;
                 }
-                case 9: save_all(); cout << "Saved all.\n"; break;
+                case 9: {
+                    int rows = lib.save_all();
+                    if (rows < 0) cout << "Save failed; changes kept for the next save.\n";
+                    else cout << "Saved all (" << rows << " changed rows).\n";
+                    break;
+                }
+                case 10: overdueNotices(); break;
+                case 11: searchBooks(); break;
+                case 12: printCacheStats(); break;
+                case 13: catalogSummary(); break;
+                case 14: {
+                    clearInputLine();
+                    string path;
+                    cout << "Snapshot file: "; getline(cin, path);
+                    cout << lib.export_snapshot(path).message << "\n";
+                    break;
+                }
+                case 15: topRatedBooks(); break;
+                case 16: historySearch(); break;
+                case 17: archiveHistory(); break;
+                case 18: circulationReports(); break;
+                case 19: cout << lib.metrics_json() << "\n"; break;
+                case 20: copyStatus(); break;
                 case 0: return;
                 default: cout << "Invalid choice.\n";
             }
@@ -839,7 +3739,8 @@ public:
         int choice;
         while (true) {
             cout << "\n--- USER MENU ---\n";
-            cout << "1. View Books\n2. Issue Book\n3. Return Book\n4. Check Status\n0. Exit\n";
+            cout << "1. View Books\n2. Issue Book\n3. Return Book\n4. Check Status\n5. Search Books\n0. Exit\n";
+            lib.flush_group_commit();   // nothing stays uncommitted while the menu waits
             choice = readMenuChoice();
 
             switch (choice) {
@@ -847,31 +3748,237 @@ public:
                 case 2: user_request_issue(); break;
                 case 3: user_request_return(); break;
                 case 4: user_check_status(); break;
+                case 5: searchBooks(); break;
                 case 0: return;
                 default: cout << "Invalid choice.\n";
             }
         }
     }
+
+    // Main menu; returns when the user picks Exit
+    void run() {
+        int choice;
+
+        while (true) {
+            cout << "\n===== Library Management System =====\n";
+            cout << "1. Admin\n2. User\n3. Exit\n";
+            choice = readMenuChoice();
+
+            switch (choice) {
+                case 1: admin_menu(); break;
+                case 2: user_menu(); break;
+                case 3: cout << "Goodbye!\n"; return;
+                default: cout << "Invalid choice.\n";
+            }
+        }
+    }
 };
 
-int main() {
-    Library lib;
-    
+// Entry point. The benchmark harness (bench/library_bench.cpp) compiles this
+// file with LIBRARY_NO_MAIN to drive Library directly.
+#ifndef LIBRARY_NO_MAIN
+
+// Parse command-line options into a LibraryConfig; returns false on bad usage
+bool parse_args(int argc, char** argv, LibraryConfig& cfg) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--db" && hasValue) {
+            cfg.db_file = argv[++i];
+        } else if (arg == "--load-stats") {
+            cfg.print_load_stats = true;
+        } else if (arg == "--page-rows" && hasValue) {
+            cfg.page_rows = max(0, atoi(argv[++i]));
+        } else if (arg == "--metrics-file" && hasValue) {
+            cfg.metrics_file = argv[++i];
+        } else if (arg == "--render-bench") {
+            cfg.render_bench = true;
+        } else if (arg == "--lazy-cache-mb" && hasValue) {
+            cfg.lazy_catalog = true;
+            cfg.cache_bytes = (size_t)max(1, atoi(argv[++i])) << 20;
+        } else if (arg == "--group-commit") {
+            cfg.group_commit = true;
+        } else if (arg == "--group-commit-ops" && hasValue) {
+            cfg.group_commit = true;
+            cfg.group_commit_ops = max(1, atoi(argv[++i]));
+        } else if (arg == "--group-commit-ms" && hasValue) {
+            cfg.group_commit = true;
+            cfg.group_commit_ms = max(0, atoi(argv[++i]));
+        } else if (arg == "--write-behind") {
+            cfg.write_behind = true;
+        } else if (arg == "--write-behind-ms" && hasValue) {
+            cfg.write_behind = true;
+            cfg.write_behind_ms = max(1, atoi(argv[++i]));
+        } else if (arg == "--write-behind-max-lag" && hasValue) {
+            cfg.write_behind = true;
+            cfg.write_behind_max_lag = max(1, atoi(argv[++i]));
+        } else if (arg == "--oplog" && hasValue) {
+            cfg.oplog_file = argv[++i];
+        } else if (arg == "--oplog-sync-ms" && hasValue) {
+            cfg.oplog_sync_ms = max(0, atoi(argv[++i]));
+        } else if (arg == "--oplog-checkpoint-ops" && hasValue) {
+            cfg.oplog_checkpoint_ops = max(1, atoi(argv[++i]));
+        } else if (arg == "--max-loans" && hasValue) {
+            cfg.max_loans = max(1, atoi(argv[++i]));
+        } else if (arg == "--journal" && hasValue) {
+            string mode = argv[++i];
+            if (mode != "wal" && mode != "delete") {
+                cout << "--journal must be wal or delete\n";
+                return false;
+            }
+            cfg.wal = mode == "wal";
+        } else if (arg == "--synchronous" && hasValue) {
+            cfg.synchronous = argv[++i];
+            if (cfg.synchronous != "off" && cfg.synchronous != "normal" && cfg.synchronous != "full") {
+                cout << "--synchronous must be off, normal or full\n";
+                return false;
+            }
+        } else if (arg == "--checkpoint-pages" && hasValue) {
+            cfg.checkpoint_pages = max(0, atoi(argv[++i]));
+        } else if (arg == "--readers" && hasValue) {
+            cfg.read_connections = max(0, atoi(argv[++i]));
+        } else if (arg == "--import" && hasValue) {
+            cfg.import_file = argv[++i];
+        } else if (arg == "--export" && hasValue) {
+            cfg.export_file = argv[++i];
+        } else if (arg == "--restore" && hasValue) {
+            cfg.restore_file = argv[++i];
+        } else if (arg == "--serve" && hasValue) {
+            cfg.serve_port = atoi(argv[++i]);
+        } else if (arg == "--workers" && hasValue) {
+            cfg.server_workers = max(0, atoi(argv[++i]));
+        } else if (arg == "--loadgen" && hasValue) {
+            cfg.loadgen_port = atoi(argv[++i]);
+        } else if (arg == "--clients" && hasValue) {
+            cfg.loadgen_clients = max(1, atoi(argv[++i]));
+        } else if (arg == "--requests" && hasValue) {
+            cfg.loadgen_requests = max(1, atoi(argv[++i]));
+        } else if (arg == "--hot-books" && hasValue) {
+            cfg.loadgen_hot_books = max(0, atoi(argv[++i]));
+        } else if (arg == "--batch" && hasValue) {
+            cfg.batch_file = argv[++i];
+        } else if (arg == "--batch-size" && hasValue) {
+            cfg.batch_size = max(1, atoi(argv[++i]));
+        } else {
+            cout << "Unknown option: " << arg << "\n";
+            cout << "Usage: " << argv[0] << " [--db FILE] [--journal wal|delete] [--synchronous off|normal|full] [--checkpoint-pages N] [--readers N] [--load-stats] [--page-rows N] [--render-bench] [--metrics-file FILE] [--lazy-cache-mb MB] [--group-commit] [--group-commit-ops N] [--group-commit-ms MS] [--write-behind] [--write-behind-ms MS] [--write-behind-max-lag N] [--oplog FILE] [--oplog-sync-ms MS] [--oplog-checkpoint-ops N] [--max-loans N] [--restore FILE] [--import FILE] [--batch FILE|-] [--batch-size N] [--export FILE]\n"
+                 << "       " << argv[0] << " [--db FILE] --serve PORT [--workers N]\n"
+                 << "       " << argv[0] << " --loadgen PORT [--clients N] [--requests N] [--hot-books N]\n";
+            return false;
+        }
+    }
+    return true;
+}
 
-    int choice;
+static volatile sig_atomic_t stop_requested = 0;
 
-    while (true) {
-        cout << "\n===== Library Management System =====\n";
-        cout << "1. Admin\n2. User\n3. Exit\n";
-        choice = lib.readMenuChoice();
+static void request_stop(int) {
+    stop_requested = 1;
+}
 
-        switch (choice) {
-            case 1: lib.admin_menu(); break;
-            case 2: lib.user_menu(); break;
-            case 3: cout << "Goodbye!\n"; return 0;
-            default: cout << "Invalid choice.\n";
+#ifdef SIGUSR1
+static void request_metrics(int) {
+    Library::metrics_dump_requested = 1;
+}
+#endif
+
+// Serve requests until SIGINT/SIGTERM; the Library saves on the way out
+int serve(Library& lib, const LibraryConfig& cfg) {
+#ifdef _WIN32
+    (void)lib;
+    (void)cfg;
+    cout << "Server mode is not available on Windows.\n";
+    return 1;
+#else
+    size_t workers = cfg.server_workers > 0 ? (size_t)cfg.server_workers : max(1u, thread::hardware_concurrency());
+    LineServer server([&lib](const string& line) { return lib.handle_request(line); }, workers);
+    string err;
+    if (!server.listen(cfg.serve_port, err)) {
+        cout << "Cannot listen on port " << cfg.serve_port << ": " << err << "\n";
+        return 1;
+    }
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    cout << "Serving on 127.0.0.1:" << cfg.serve_port << " with " << workers << " workers (Ctrl+C to stop)" << endl;
+    server.run(&stop_requested, [&lib] { lib.tick(); }, max(10, cfg.group_commit_ms));
+    cout << "Server stopped.\n";
+    return 0;
+#endif
+}
+
+int main(int argc, char** argv) {
+    LibraryConfig cfg;
+    if (!parse_args(argc, argv, cfg)) return 1;
+
+    if (cfg.loadgen_port > 0) {
+#ifdef _WIN32
+        cout << "The load generator is not available on Windows.\n";
+        return 1;
+#else
+        LoadGenerator::Options opt;
+        opt.port = cfg.loadgen_port;
+        opt.clients = cfg.loadgen_clients;
+        opt.requests = cfg.loadgen_requests;
+        opt.hot_books = cfg.loadgen_hot_books;
+        return LoadGenerator::run(opt, cout) ? 0 : 1;
+#endif
+    }
+
+    if (!cfg.restore_file.empty()) {
+        auto start = chrono::steady_clock::now();
+        Snapshot::Stats st;
+        string err;
+        if (!Snapshot::restore(cfg.restore_file, cfg.db_file, st, err)) {
+            cout << "Restore failed: " << err << "\n";
+            return 1;
+        }
+        cout << "Restored " << st.rows << " rows from " << st.tables << " tables into " << cfg.db_file << " in "
+             << fixed << setprecision(3) << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms\n";
+        // The log describes the database that was just replaced
+        if (!cfg.oplog_file.empty() && remove(cfg.oplog_file.c_str()) == 0) cout << "Discarded the operation log " << cfg.oplog_file << "\n";
+    }
+
+#ifdef SIGUSR1
+    signal(SIGUSR1, request_metrics);
+#endif
+    cfg.notify = [](const string& msg) { cout << msg << endl; };
+    Library lib(cfg);
+    LibraryConsole console(lib, cfg.page_rows);
+    if (cfg.print_load_stats) console.printLoadStats();
+
+    // One-shot modes run in this order and exit instead of showing the menus
+    bool oneShot = !cfg.import_file.empty() || !cfg.batch_file.empty() || !cfg.export_file.empty() || cfg.render_bench;
+    int status = 0;
+    if (!cfg.import_file.empty()) {
+        OpResult r = lib.import_books(cfg.import_file, cout);
+        cout << r.message << "\n";
+        if (!r.ok) return 1;
+    }
+
+    if (!cfg.batch_file.empty()) {
+        ifstream file;
+        if (cfg.batch_file != "-") {
+            file.open(cfg.batch_file);
+            if (!file) {
+                cout << "Cannot open batch file: " << cfg.batch_file << "\n";
+                return 1;
+            }
         }
+        if (lib.run_batch(cfg.batch_file == "-" ? cin : file, cout) != 0) status = 1;
     }
 
+    if (!cfg.export_file.empty()) {
+        OpResult r = lib.export_snapshot(cfg.export_file);
+        cout << r.message << "\n";
+        if (!r.ok) return 1;
+    }
+
+    if (cfg.render_bench) console.renderBenchmark(cout);
+    if (cfg.serve_port > 0) return status != 0 ? status : serve(lib, cfg);
+    if (oneShot) return status;
+
+    console.run();
     return 0;
 }
+
+#endif  // LIBRARY_NO_MAIN
@@ -0,0 +1,234 @@
+#ifndef LINE_SERVER_H
+#define LINE_SERVER_H
+
+#ifndef _WIN32
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// ----------------------
+// LineServer: TCP server for a line-based request/response protocol on
+// 127.0.0.1. One thread runs a poll() event loop that accepts clients and
+// splits their input into lines; each line is handed to a worker pool
+// together with its connection, and the worker writes the handler's reply
+// as one line. A connection has at most one request in flight, so replies
+// come back in request order, while different connections run in parallel.
+// ----------------------
+class LineServer {
+public:
+    using Handler = std::function<std::string(const std::string&)>;
+
+private:
+    static const size_t MAX_LINE = 64 * 1024;
+
+    struct Conn {
+        int fd;
+        std::string in;       // bytes received but not yet dispatched
+        bool busy = false;    // a worker owns the connection
+        bool closed = false;  // peer hung up or a write failed
+
+        explicit Conn(int f) : fd(f) {
+
+        }
+    };
+    struct Job {
+        Conn* conn;
+        std::string line;
+    };
+
+    Handler handler;
+    size_t nworkers;
+    int listen_fd = -1;
+    int wake[2] = {-1, -1};   // workers -> event loop: a connection is free again
+    std::map<int, std::unique_ptr<Conn>> conns;
+
+    std::mutex m;
+    std::condition_variable ready;
+    std::deque<Job> jobs;
+    std::vector<Conn*> finished;
+    bool stopping = false;
+
+    static bool send_all(int fd, const std::string& data) {
+        size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = ::send(fd, data.data() + off, data.size() - off, 0);
+            if (n > 0) {
+                off += (size_t)n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                pollfd p{fd, POLLOUT, 0};
+                poll(&p, 1, 1000);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void worker() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                ready.wait(lock, [&] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            std::string reply = handler(job.line);
+            reply += '\n';
+            if (!send_all(job.conn->fd, reply)) job.conn->closed = true;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                finished.push_back(job.conn);
+            }
+            char b = 1;
+            (void)!::write(wake[1], &b, 1);
+        }
+    }
+
+    // Hand the next complete line of an idle connection to the pool
+    void dispatch(Conn* c) {
+        if (c->busy || c->closed) return;
+        size_t nl = c->in.find('\n');
+        if (nl == std::string::npos) {
+            if (c->in.size() > MAX_LINE) c->closed = true;
+            return;
+        }
+        std::string line = c->in.substr(0, nl);
+        c->in.erase(0, nl + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line == "quit") {
+            c->closed = true;
+            return;
+        }
+        c->busy = true;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            jobs.push_back({c, std::move(line)});
+        }
+        ready.notify_one();
+    }
+
+    void close_conn(int fd) {
+        ::close(fd);
+        conns.erase(fd);
+    }
+
+public:
+    LineServer(Handler h, size_t workers) : handler(std::move(h)), nworkers(workers ? workers : 1) {
+
+    }
+    ~LineServer() {
+        for (auto& c : conns) ::close(c.first);
+        if (listen_fd >= 0) ::close(listen_fd);
+        if (wake[0] >= 0) { ::close(wake[0]); ::close(wake[1]); }
+    }
+
+    LineServer(const LineServer&) = delete;
+    LineServer& operator=(const LineServer&) = delete;
+
+    bool listen(int port, std::string& err) {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0) { err = strerror(errno); return false; }
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(listen_fd, 128) < 0) {
+            err = strerror(errno);
+            return false;
+        }
+        fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+        if (::pipe(wake) < 0) { err = strerror(errno); return false; }
+        fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    // Serve until *stop becomes nonzero; on_tick runs roughly every tick_ms
+    void run(volatile sig_atomic_t* stop, const std::function<void()>& on_tick, int tick_ms) {
+        signal(SIGPIPE, SIG_IGN);
+        std::vector<std::thread> pool;
+        for (size_t i = 0; i < nworkers; i++) pool.emplace_back([this] { worker(); });
+
+        std::vector<pollfd> fds;
+        while (!*stop) {
+            fds.clear();
+            fds.push_back({listen_fd, POLLIN, 0});
+            fds.push_back({wake[0], POLLIN, 0});
+            for (auto& c : conns) {
+                if (!c.second->busy) fds.push_back({c.first, POLLIN, 0});
+            }
+            int n = poll(fds.data(), fds.size(), tick_ms);
+            if (on_tick) on_tick();
+            if (n <= 0) continue;
+
+            if (fds[0].revents & POLLIN) {
+                int fd;
+                while ((fd = ::accept(listen_fd, nullptr, nullptr)) >= 0) {
+                    int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    conns[fd] = std::make_unique<Conn>(fd);
+                }
+            }
+
+            if (fds[1].revents & POLLIN) {
+                char buf[256];
+                while (::read(wake[0], buf, sizeof(buf)) > 0) {}
+                std::vector<Conn*> done;
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    done.swap(finished);
+                }
+                for (Conn* c : done) {
+                    c->busy = false;
+                    dispatch(c);
+                    if (c->closed && !c->busy) close_conn(c->fd);
+                }
+            }
+
+            for (size_t i = 2; i < fds.size(); i++) {
+                if (!fds[i].revents) continue;
+                auto it = conns.find(fds[i].fd);
+                if (it == conns.end()) continue;
+                Conn* c = it->second.get();
+                char buf[16 * 1024];
+                ssize_t r;
+                while ((r = ::read(c->fd, buf, sizeof(buf))) > 0) c->in.append(buf, (size_t)r);
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) c->closed = true;
+                dispatch(c);
+                if (c->closed && !c->busy) close_conn(c->fd);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& t : pool) t.join();
+    }
+};
+
+#endif  // _WIN32
+
+#endif
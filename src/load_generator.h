@@ -0,0 +1,183 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <ostream>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// ----------------------
+// LoadGenerator: drives a running server (see LineServer) from several
+// client threads over localhost and reports throughput and latency
+// percentiles. Each client owns one synthetic user (ids from user_base up)
+// and loops over a read-heavy kiosk mix: 40% search, 25% status, 20% book
+// lookup, 5% history (the client's own loans or the most recent), 10%
+// issue-or-return. Books are drawn from ids 1..books.
+// With hot_books set, every request is an issue or return of one of books
+// 1..hot_books, so clients fight over a few copies; the server's `audit`
+// is checked afterwards to prove no book was promised twice.
+// ----------------------
+class LoadGenerator {
+public:
+    struct Options {
+        int port = 7878;
+        int clients = 8;
+        int requests = 10000;     // per client
+        int user_base = 1000000;
+        int hot_books = 0;        // >0: contention mode on books 1..hot_books
+    };
+
+private:
+    // A blocking line-oriented connection
+    class Client {
+    private:
+        int fd = -1;
+        std::string buf;
+
+    public:
+        ~Client() {
+            if (fd >= 0) ::close(fd);
+        }
+        bool connect(int port) {
+            fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0) return false;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons((uint16_t)port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            return ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+        }
+        // Send one request and wait for its reply line
+        bool call(const std::string& req, std::string& reply) {
+            std::string line = req + "\n";
+            size_t off = 0;
+            while (off < line.size()) {
+                ssize_t n = ::send(fd, line.data() + off, line.size() - off, 0);
+                if (n <= 0) return false;
+                off += (size_t)n;
+            }
+            size_t nl;
+            while ((nl = buf.find('\n')) == std::string::npos) {
+                char tmp[16 * 1024];
+                ssize_t n = ::recv(fd, tmp, sizeof(tmp), 0);
+                if (n <= 0) return false;
+                buf.append(tmp, (size_t)n);
+            }
+            reply.assign(buf, 0, nl);
+            buf.erase(0, nl + 1);
+            return true;
+        }
+    };
+
+    struct ClientResult {
+        std::vector<double> latency_us;
+        size_t errors = 0;      // ERR replies (business errors, e.g. no copies left)
+        bool failed = false;    // connection problems
+    };
+
+    static void run_client(const Options& o, int idx, int books, ClientResult& res) {
+        Client c;
+        if (!c.connect(o.port)) { res.failed = true; return; }
+        std::mt19937 rng(12345u + (unsigned)idx);
+        int uid = o.user_base + idx;
+        std::string reply;
+        if (!c.call("add-user " + std::to_string(uid) + " | loadgen " + std::to_string(idx), reply)) { res.failed = true; return; }
+        if (!c.call("return " + std::to_string(uid), reply)) { res.failed = true; return; }   // leftover loan from an earlier run
+
+        bool holding = false;
+        std::uniform_int_distribution<int> pick(0, 99);
+        std::uniform_int_distribution<int> book(1, std::max(1, o.hot_books > 0 ? std::min(books, o.hot_books) : books));
+        res.latency_us.reserve((size_t)o.requests);
+        for (int i = 0; i < o.requests; i++) {
+            int r = o.hot_books > 0 ? 99 : pick(rng);
+            std::string req;
+            bool circulation = false;
+            if (r < 40) req = "search " + std::to_string(book(rng));
+            else if (r < 65) req = "status " + std::to_string(uid);
+            else if (r < 85) req = "book " + std::to_string(book(rng));
+            else if (r < 90) req = r % 2 ? "history user " + std::to_string(uid) + " 5" : "history recent 5";
+            else {
+                circulation = true;
+                req = holding ? "return " + std::to_string(uid) : "issue " + std::to_string(uid) + " " + std::to_string(book(rng));
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            if (!c.call(req, reply)) { res.failed = true; return; }
+            res.latency_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+
+            bool ok = reply.compare(0, 2, "OK") == 0;
+            if (!ok) res.errors++;
+            if (circulation && ok) holding = !holding;
+        }
+        if (holding) c.call("return " + std::to_string(uid), reply);
+    }
+
+    static double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0.0;
+        size_t i = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+        return sorted[std::min(i, sorted.size() - 1)];
+    }
+
+public:
+    // Run the load and print a report; false if the server could not be used
+    static bool run(const Options& o, std::ostream& out) {
+        Client probe;
+        std::string info;
+        if (!probe.connect(o.port) || !probe.call("info", info)) {
+            out << "Cannot reach server on 127.0.0.1:" << o.port << "\n";
+            return false;
+        }
+        int books = 0;
+        size_t at = info.find("books=");
+        if (at != std::string::npos) books = atoi(info.c_str() + at + 6);
+        if (books <= 0) {
+            out << "Server has no books to circulate.\n";
+            return false;
+        }
+
+        std::vector<ClientResult> results((size_t)o.clients);
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < o.clients; i++) threads.emplace_back(run_client, std::cref(o), i, books, std::ref(results[(size_t)i]));
+        for (auto& t : threads) t.join();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> all;
+        size_t errors = 0, failed = 0;
+        for (auto& r : results) {
+            all.insert(all.end(), r.latency_us.begin(), r.latency_us.end());
+            errors += r.errors;
+            failed += r.failed ? 1 : 0;
+        }
+        std::sort(all.begin(), all.end());
+        out << "Clients: " << o.clients << " | Requests: " << all.size() << " | ERR replies: " << errors
+            << " | Failed clients: " << failed << "\n";
+        out << std::fixed << std::setprecision(0) << "Throughput: " << (secs > 0 ? all.size() / secs : 0.0) << " ops/sec over "
+            << std::setprecision(3) << secs << " s\n";
+        out << std::setprecision(1) << "Latency (us): p50 " << percentile(all, 0.50) << " | p90 " << percentile(all, 0.90)
+            << " | p99 " << percentile(all, 0.99) << " | max " << (all.empty() ? 0.0 : all.back()) << "\n";
+
+        std::string audit;
+        bool balanced = probe.call("audit", audit) && audit.compare(0, 2, "OK") == 0;
+        out << "Copy audit: " << (audit.empty() ? "no reply" : audit) << "\n";
+        return failed == 0 && balanced;
+    }
+};
+
+#endif  // _WIN32
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+};
+
+// ----------------------
+// LruCache: int-keyed cache bounded by an estimated byte footprint.
+// The least recently used entries are evicted once the total exceeds the
+// ceiling; the eviction handler sees each victim before it is dropped.
+// A few most-recent entries are never evicted, so an operation can hold
+// on to the handful of rows it is working with.
+// ----------------------
+template <class V>
+class LruCache {
+private:
+    struct Node {
+        int key;
+        V value;
+        size_t bytes;
+    };
+
+    static const size_t MIN_ENTRIES = 8;
+
+    std::list<Node> lru;   // front = most recently used
+    std::unordered_map<int, typename std::list<Node>::iterator> index;
+    size_t bytes = 0;
+    size_t capacity_bytes;
+    CacheStats stats;
+    std::function<void(int, V&)> on_evict;
+
+    void evict_to_fit() {
+        while (bytes > capacity_bytes && lru.size() > MIN_ENTRIES) {
+            Node& victim = lru.back();
+            if (on_evict) on_evict(victim.key, victim.value);
+            bytes -= victim.bytes;
+            index.erase(victim.key);
+            lru.pop_back();
+            stats.evictions++;
+        }
+    }
+
+public:
+    explicit LruCache(size_t capacity = 64u << 20) : capacity_bytes(capacity) {
+
+    }
+
+    void set_capacity(size_t capacity) {
+        capacity_bytes = capacity;
+        evict_to_fit();
+    }
+
+    void set_evict_handler(std::function<void(int, V&)> fn) {
+        on_evict = std::move(fn);
+    }
+
+    // Lookup that counts a hit or miss and refreshes recency
+    V* get(int key) {
+        auto it = index.find(key);
+        if (it == index.end()) {
+            stats.misses++;
+            return nullptr;
+        }
+        stats.hits++;
+        lru.splice(lru.begin(), lru, it->second);
+        return &it->second->value;
+    }
+
+    // Lookup without touching recency or statistics
+    V* peek(int key) {
+        auto it = index.find(key);
+        return it == index.end() ? nullptr : &it->second->value;
+    }
+
+    // Insert or replace; `size` is the caller's estimate of the entry's footprint
+    V& put(int key, V value, size_t size) {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            bytes -= it->second->bytes;
+            it->second->value = std::move(value);
+            it->second->bytes = size;
+            lru.splice(lru.begin(), lru, it->second);
+        } else {
+            lru.push_front(Node{key, std::move(value), size});
+            index[key] = lru.begin();
+        }
+        bytes += size;
+        evict_to_fit();
+        return lru.front().value;
+    }
+
+    bool erase(int key) {
+        auto it = index.find(key);
+        if (it == index.end()) return false;
+        bytes -= it->second->bytes;
+        lru.erase(it->second);
+        index.erase(it);
+        return true;
+    }
+
+    void clear() {
+        lru.clear();
+        index.clear();
+        bytes = 0;
+    }
+
+    size_t size() const {
+        return lru.size();
+    }
+    size_t footprint() const {
+        return bytes;
+    }
+    size_t capacity() const {
+        return capacity_bytes;
+    }
+    const CacheStats& statistics() const {
+        return stats;
+    }
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "sqlite3.h"
+
+// ----------------------
+// LatencyHistogram: nanosecond latencies in log-linear buckets, 4 per
+// power of two, so any value is placed within 25% of its true size.
+// Recording is a few relaxed atomic adds, so many threads can record
+// at once without locking.
+// ----------------------
+class LatencyHistogram {
+public:
+    static constexpr int SUB = 4;                 // buckets per power of two
+    static constexpr int BUCKETS = 64 * SUB;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> n{0};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+
+    static int log2_floor(uint64_t v) {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(v);
+#else
+        int r = 0;
+        while (v >>= 1) r++;
+        return r;
+#endif
+    }
+
+public:
+    static int bucket_of(uint64_t ns) {
+        if (ns < (uint64_t)SUB) return (int)ns;
+        int p = log2_floor(ns);   // >= 2
+        return p * SUB + (int)((ns >> (p - 2)) & (SUB - 1));
+    }
+
+    // Smallest value that falls in the next bucket
+    static uint64_t bucket_limit(int b) {
+        if (b < SUB) return (uint64_t)b + 1;
+        int p = b / SUB, s = b % SUB;
+        if (p >= 63 && s == SUB - 1) return UINT64_MAX;
+        return (uint64_t)(SUB + s + 1) << (p - 2);
+    }
+
+    void record(uint64_t ns) {
+        buckets[(size_t)bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        n.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t m = max_ns.load(std::memory_order_relaxed);
+        while (ns > m && !max_ns.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    // A consistent-enough copy for reporting (other threads keep recording)
+    struct Snapshot {
+        uint64_t count = 0, sum_ns = 0, max_ns = 0;
+        std::array<uint64_t, BUCKETS> buckets{};
+
+        // Upper bound of the bucket holding the p-quantile (p in [0, 1])
+        uint64_t quantile(double p) const {
+            uint64_t total = 0;
+            for (uint64_t c : buckets) total += c;
+            if (total == 0) return 0;
+            uint64_t rank = (uint64_t)(p * (double)(total - 1)) + 1, seen = 0;
+            for (int b = 0; b < BUCKETS; b++) {
+                seen += buckets[(size_t)b];
+                if (seen >= rank) return std::min(bucket_limit(b), max_ns);
+            }
+            return max_ns;
+        }
+    };
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        for (int b = 0; b < BUCKETS; b++) s.buckets[(size_t)b] = buckets[(size_t)b].load(std::memory_order_relaxed);
+        s.count = n.load(std::memory_order_relaxed);
+        s.sum_ns = sum_ns.load(std::memory_order_relaxed);
+        s.max_ns = max_ns.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+// ----------------------
+// Metrics: one latency histogram per Library operation plus SQLite work
+// counters, rendered as one line of JSON. Operations are timed with a
+// scoped Timer. SQLite statements run and rows returned are counted by a
+// sqlite3_trace_v2 callback attached to each connection (attach()).
+// Everything is lock-free, so it stays on in production.
+// ----------------------
+class Metrics {
+public:
+    enum Op {
+        ISSUE, RETURN, ADD_BOOK, REMOVE_BOOK, ADD_USER, REMOVE_USER,
+        SEARCH, HISTORY, LOAD, SAVE, COMMIT, REQUEST, OP_COUNT
+    };
+
+    static const char* op_name(Op op) {
+        static const char* names[OP_COUNT] = {"issue", "return", "add_book", "remove_book", "add_user", "remove_user",
+                                              "search", "history", "load", "save", "commit", "request"};
+        return names[op];
+    }
+
+    class Timer {
+    private:
+        LatencyHistogram& h;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        Timer(Metrics& m, Op op) : h(m.ops[op]), start(std::chrono::steady_clock::now()) {
+
+        }
+        ~Timer() {
+            h.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+private:
+    std::array<LatencyHistogram, OP_COUNT> ops;
+    std::atomic<uint64_t> statements{0};   // statement runs started
+    std::atomic<uint64_t> rows{0};         // result rows returned
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    static int on_trace(unsigned type, void* ctx, void*, void*) {
+        Metrics* m = static_cast<Metrics*>(ctx);
+        if (type == SQLITE_TRACE_STMT) m->statements.fetch_add(1, std::memory_order_relaxed);
+        else if (type == SQLITE_TRACE_ROW) m->rows.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    static void append_us(std::string& out, const char* key, uint64_t ns) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "\"%s\":%.1f", key, (double)ns / 1000.0);
+        out += buf;
+    }
+
+public:
+    // Count the statements and rows of conn
+    void attach(sqlite3* conn) {
+        if (conn) sqlite3_trace_v2(conn, SQLITE_TRACE_STMT | SQLITE_TRACE_ROW, &Metrics::on_trace, this);
+    }
+
+    void record(Op op, uint64_t ns) {
+        ops[op].record(ns);
+    }
+
+    // {"uptime_s":..,"ops":{name:{count,mean_us,p50_us,p90_us,p99_us,max_us,
+    // buckets:[[upper_us,count],..]},..},"sqlite":{..},"sizes":{..}}
+    // extra_sqlite and sizes are name/value pairs supplied by the caller.
+    std::string to_json(const std::vector<std::pair<std::string, int64_t>>& extra_sqlite,
+                        const std::vector<std::pair<std::string, int64_t>>& sizes) const {
+        std::string out = "{\"uptime_s\":";
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.3f", std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+        out += buf;
+        out += ",\"ops\":{";
+        for (int i = 0; i < OP_COUNT; i++) {
+            LatencyHistogram::Snapshot s = ops[(size_t)i].snapshot();
+            if (i) out += ',';
+            out += '"';
+            out += op_name((Op)i);
+            out += "\":{\"count\":" + std::to_string(s.count) + ',';
+            append_us(out, "mean_us", s.count ? s.sum_ns / s.count : 0);
+            out += ',';
+            append_us(out, "p50_us", s.quantile(0.50));
+            out += ',';
+            append_us(out, "p90_us", s.quantile(0.90));
+            out += ',';
+            append_us(out, "p99_us", s.quantile(0.99));
+            out += ',';
+            append_us(out, "max_us", s.max_ns);
+            out += ",\"buckets\":[";
+            bool first = true;
+            for (int b = 0; b < LatencyHistogram::BUCKETS; b++) {
+                if (!s.buckets[(size_t)b]) continue;
+                snprintf(buf, sizeof(buf), "%s[%.3f,%llu]", first ? "" : ",", (double)LatencyHistogram::bucket_limit(b) / 1000.0,
+                         (unsigned long long)s.buckets[(size_t)b]);
+                out += buf;
+                first = false;
+            }
+            out += "]}";
+        }
+        out += "},\"sqlite\":{\"statements\":" + std::to_string(statements.load(std::memory_order_relaxed))
+             + ",\"rows_returned\":" + std::to_string(rows.load(std::memory_order_relaxed));
+        for (auto& e : extra_sqlite) out += ",\"" + e.first + "\":" + std::to_string(e.second);
+        out += "},\"sizes\":{";
+        for (size_t i = 0; i < sizes.size(); i++) out += (i ? ",\"" : "\"") + sizes[i].first + "\":" + std::to_string(sizes[i].second);
+        out += "}}";
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,347 @@
+#ifndef OP_JOURNAL_H
+#define OP_JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// ----------------------
+// OpJournal: append-only binary log of operations, one record per
+// operation, read back after a crash to redo what the database lost.
+//
+// File layout (integers little-endian):
+//   "LMSOPLG1", then records: u32 payload bytes, u32 FNV-1a checksum of
+//   seq + payload, u64 seq, payload.
+// Sequence numbers rise by one per record and keep rising across reset(),
+// so the database can store the last one it holds and replay skips the
+// rest. A torn or corrupt record ends the log; nothing after it is read.
+// The payload is the caller's; put_*/Cursor encode integers as (zigzag)
+// varints and strings as varint length + bytes.
+//
+// Every append is written to the file straight away, which survives the
+// process being killed. fsync is batched: a background thread syncs at
+// most sync_ms after an append, or every append is synced when sync_ms is
+// 0. append() and reset() must be called by one thread at a time.
+// ----------------------
+class OpJournal {
+public:
+    struct Cursor {
+        const char* p;
+        const char* end;
+
+        bool varint(uint64_t& v) {
+            v = 0;
+            for (int shift = 0; shift < 64 && p < end; shift += 7) {
+                unsigned char c = (unsigned char)*p++;
+                v |= (uint64_t)(c & 0x7F) << shift;
+                if (!(c & 0x80)) return true;
+            }
+            return false;
+        }
+        bool i64(int64_t& v) {
+            uint64_t z;
+            if (!varint(z)) return false;
+            v = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+            return true;
+        }
+        bool i32(int& v) {
+            int64_t x;
+            if (!i64(x)) return false;
+            v = (int)x;
+            return true;
+        }
+        bool str(std::string& s) {
+            uint64_t n;
+            if (!varint(n) || (uint64_t)(end - p) < n) return false;
+            s.assign(p, (size_t)n);
+            p += n;
+            return true;
+        }
+    };
+
+    static void put_varint(std::string& out, uint64_t v) {
+        while (v >= 0x80) {
+            out += (char)((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        out += (char)v;
+    }
+    static void put_i64(std::string& out, int64_t v) {
+        put_varint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+    }
+    static void put_str(std::string& out, const std::string& s) {
+        put_varint(out, s.size());
+        out += s;
+    }
+
+    struct ScanStats {
+        size_t records = 0;
+        uint64_t last_seq = 0;
+        uint64_t ignored_bytes = 0;   // torn or corrupt tail
+    };
+
+private:
+    static constexpr char MAGIC[9] = "LMSOPLG1";
+    static const size_t HEADER = 8;
+    static const size_t RECORD_HEAD = 16;
+    static const uint32_t MAX_PAYLOAD = 1u << 24;
+
+    int fd = -1;
+    std::string path;
+    int sync_ms = 50;
+    uint64_t seq = 0;          // last sequence number handed out
+    size_t since_reset = 0;    // records appended since the last reset()
+    std::string frame;         // reused by append()
+
+    std::atomic<uint64_t> written{0};   // last seq written to the file
+    std::atomic<uint64_t> synced{0};    // last seq known to be on disk
+    std::atomic<bool> failed{false};
+    std::thread syncer;
+    std::mutex m;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static uint32_t checksum(uint64_t s, const char* p, size_t n) {
+        uint32_t h = 2166136261u;
+        for (int i = 0; i < 8; i++) {
+            h ^= (unsigned char)(s >> (8 * i));
+            h *= 16777619u;
+        }
+        for (size_t i = 0; i < n; i++) {
+            h ^= (unsigned char)p[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    static void put_u32(char* out, uint32_t v) {
+        for (int i = 0; i < 4; i++) out[i] = (char)((v >> (8 * i)) & 0xFF);
+    }
+    static uint32_t get_u32(const char* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) v |= (uint32_t)(unsigned char)p[i] << (8 * i);
+        return v;
+    }
+
+    static bool write_all(int f, const char* p, size_t n) {
+        while (n > 0) {
+#ifdef _WIN32
+            int w = _write(f, p, (unsigned)n);
+#else
+            ssize_t w = ::write(f, p, n);
+#endif
+            if (w <= 0) return false;
+            p += w;
+            n -= (size_t)w;
+        }
+        return true;
+    }
+
+    static bool sync_fd(int f) {
+#ifdef _WIN32
+        return _commit(f) == 0;
+#elif defined(__linux__)
+        return fdatasync(f) == 0;
+#else
+        return fsync(f) == 0;
+#endif
+    }
+
+    bool sync_now() {
+        uint64_t target = written.load();
+        if (synced.load() >= target) return true;
+        if (!sync_fd(fd)) {
+            failed = true;
+            return false;
+        }
+        uint64_t cur = synced.load();
+        while (cur < target && !synced.compare_exchange_weak(cur, target)) {
+        }
+        return true;
+    }
+
+    void run_syncer() {
+        std::unique_lock<std::mutex> lock(m);
+        while (!stopping) {
+            wake.wait_for(lock, std::chrono::milliseconds(sync_ms));
+            lock.unlock();
+            sync_now();
+            lock.lock();
+        }
+    }
+
+public:
+    OpJournal() = default;
+    ~OpJournal() {
+        close();
+    }
+
+    OpJournal(const OpJournal&) = delete;
+    OpJournal& operator=(const OpJournal&) = delete;
+
+    // Read every intact record of path in order; fn returns false to stop.
+    // A missing file is an empty log. False with err set if the file
+    // cannot be read or fn stopped the scan.
+    static bool scan(const std::string& path, const std::function<bool(uint64_t, Cursor&)>& fn, ScanStats& stats, std::string& err) {
+        stats = ScanStats();
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return true;
+        std::vector<char> data;
+        char buf[1 << 16];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+        bool read_error = ferror(f) != 0;
+        fclose(f);
+        if (read_error) {
+            err = "cannot read " + path;
+            return false;
+        }
+        if (data.empty()) return true;
+        if (data.size() < HEADER || memcmp(data.data(), MAGIC, HEADER) != 0) {
+            err = path + " is not an operation log";
+            return false;
+        }
+        size_t pos = HEADER;
+        while (data.size() - pos >= RECORD_HEAD) {
+            const char* p = data.data() + pos;
+            uint32_t len = get_u32(p);
+            uint64_t s = (uint64_t)get_u32(p + 8) | (uint64_t)get_u32(p + 12) << 32;
+            if (len > MAX_PAYLOAD || data.size() - pos - RECORD_HEAD < len) break;
+            if (checksum(s, p + RECORD_HEAD, len) != get_u32(p + 4)) break;
+            if (stats.records > 0 && s != stats.last_seq + 1) break;
+            Cursor c{p + RECORD_HEAD, p + RECORD_HEAD + len};
+            if (!fn(s, c)) {
+                err = "replay stopped at operation " + std::to_string(s);
+                return false;
+            }
+            stats.records++;
+            stats.last_seq = s;
+            pos += RECORD_HEAD + len;
+        }
+        stats.ignored_bytes = data.size() - pos;
+        return true;
+    }
+
+    // Start a new, empty log at path (replacing any file there); the next
+    // record gets sequence number last_seq + 1
+    bool open(const std::string& file, uint64_t last_seq, int sync_interval_ms, std::string& err) {
+        close();
+        path = file;
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd < 0 || !write_all(fd, MAGIC, HEADER) || !sync_fd(fd)) {
+            err = "cannot create " + path;
+            close();
+            return false;
+        }
+        seq = last_seq;
+        written = synced = last_seq;
+        since_reset = 0;
+        failed = false;
+        sync_ms = sync_interval_ms;
+        stopping = false;
+        if (sync_ms > 0) syncer = std::thread([this] { run_syncer(); });
+        return true;
+    }
+
+    bool is_open() const {
+        return fd >= 0;
+    }
+
+    // Write one record; returns its sequence number, or 0 if the write
+    // failed (the log is then unusable until the next reset)
+    uint64_t append(const std::string& payload) {
+        if (fd < 0 || failed) return 0;
+        uint64_t s = seq + 1;
+        frame.resize(RECORD_HEAD);
+        put_u32(&frame[0], (uint32_t)payload.size());
+        put_u32(&frame[4], checksum(s, payload.data(), payload.size()));
+        put_u32(&frame[8], (uint32_t)s);
+        put_u32(&frame[12], (uint32_t)(s >> 32));
+        frame += payload;
+        if (!write_all(fd, frame.data(), frame.size())) {
+            failed = true;
+            return 0;
+        }
+        seq = s;
+        since_reset++;
+        written = s;
+        if (sync_ms <= 0 && !sync_now()) return 0;
+        return s;
+    }
+
+    // Every record so far is in the database: empty the log, keeping the
+    // sequence numbers going
+    bool reset() {
+        if (fd < 0) return false;
+        std::lock_guard<std::mutex> lock(m);
+#ifdef _WIN32
+        bool ok = _chsize(fd, (long)HEADER) == 0 && _lseek(fd, (long)HEADER, SEEK_SET) >= 0;
+#else
+        bool ok = ftruncate(fd, (off_t)HEADER) == 0 && lseek(fd, (off_t)HEADER, SEEK_SET) >= 0;
+#endif
+        ok = ok && sync_fd(fd);
+        if (ok) {
+            since_reset = 0;
+            failed = false;
+            synced = seq;
+        }
+        return ok;
+    }
+
+    // Wait until every record so far is on disk
+    bool sync() {
+        return fd >= 0 && sync_now();
+    }
+
+    void close() {
+        if (syncer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stopping = true;
+            }
+            wake.notify_one();
+            syncer.join();
+        }
+        if (fd >= 0) {
+            sync_now();
+#ifdef _WIN32
+            _close(fd);
+#else
+            ::close(fd);
+#endif
+        }
+        fd = -1;
+    }
+
+    uint64_t last_seq() const {
+        return seq;
+    }
+
+    size_t records() const {
+        return since_reset;
+    }
+
+    bool healthy() const {
+        return fd >= 0 && !failed;
+    }
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef RATINGS_H
+#define RATINGS_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+// ----------------------
+// RatingTally: one book's ratings as exact integers. The average is always
+// derived from sum / count, so it never accumulates rounding error no
+// matter how many ratings arrive. stars[k - 1] counts ratings of k.
+// ----------------------
+struct RatingTally {
+    int64_t sum = 0;
+    int count = 0;
+    std::array<int, 5> stars{};
+
+    // r is 1-5
+    void add(int r) {
+        sum += r;
+        count++;
+        stars[(size_t)(r - 1)]++;
+    }
+
+    double average() const {
+        return count > 0 ? (double)sum / count : 0.0;
+    }
+
+    // Ratings recorded before histograms existed: the sum is recovered from
+    // the stored average, but their stars are unknown and stay out of the
+    // breakdown
+    static RatingTally from_average(double avg, int count) {
+        RatingTally t;
+        t.count = count > 0 ? count : 0;
+        t.sum = (int64_t)std::llround(avg * t.count);
+        return t;
+    }
+};
+
+// ----------------------
+// RatingIndex: rated books kept in order, so "highest rated" and "most
+// rated" read the first K entries instead of sorting the catalog.
+// Averages are compared exactly (cross-multiplied sums). A minimum-count
+// threshold is served from the largest tier at or below it: each tier
+// holds only the books with at least that many ratings, so a query at a
+// tier threshold skips nothing, and between tiers it skips only books
+// whose count falls short.
+// ----------------------
+class RatingIndex {
+private:
+    struct Entry {
+        int64_t sum;
+        int count;
+        int id;
+    };
+    // Highest average first; ties go to the more-rated book, then the lower id
+    struct ByAverage {
+        bool operator()(const Entry& a, const Entry& b) const {
+            // a.sum / a.count > b.sum / b.count: whole parts first, then the
+            // remainders cross-multiplied (each below 2^31, so no overflow)
+            int64_t qa = a.sum / a.count, qb = b.sum / b.count;
+            if (qa != qb) return qa > qb;
+            int64_t l = (a.sum % a.count) * b.count, r = (b.sum % b.count) * a.count;
+            if (l != r) return l > r;
+            if (a.count != b.count) return a.count > b.count;
+            return a.id < b.id;
+        }
+    };
+    struct ByCount {
+        bool operator()(const Entry& a, const Entry& b) const {
+            if (a.count != b.count) return a.count > b.count;
+            return a.id < b.id;
+        }
+    };
+
+    std::vector<int> tiers;                           // ascending, tiers[0] == 1
+    std::vector<std::set<Entry, ByAverage>> by_average;   // by_average[i]: count >= tiers[i]
+    std::set<Entry, ByCount> by_count;
+
+public:
+    explicit RatingIndex(std::vector<int> thresholds = {1, 5, 20, 100}) : tiers(std::move(thresholds)) {
+        if (tiers.empty() || tiers[0] != 1) tiers.insert(tiers.begin(), 1);
+        by_average.resize(tiers.size());
+    }
+
+    void insert(int id, const RatingTally& t) {
+        if (t.count <= 0) return;
+        Entry e{t.sum, t.count, id};
+        for (size_t i = 0; i < tiers.size() && t.count >= tiers[i]; i++) by_average[i].insert(e);
+        by_count.insert(e);
+    }
+
+    // t must be the tally the book was inserted with
+    void erase(int id, const RatingTally& t) {
+        if (t.count <= 0) return;
+        Entry e{t.sum, t.count, id};
+        for (size_t i = 0; i < tiers.size() && t.count >= tiers[i]; i++) by_average[i].erase(e);
+        by_count.erase(e);
+    }
+
+    void update(int id, const RatingTally& before, const RatingTally& after) {
+        if (before.sum == after.sum && before.count == after.count) return;
+        erase(id, before);
+        insert(id, after);
+    }
+
+    void clear() {
+        for (auto& s : by_average) s.clear();
+        by_count.clear();
+    }
+
+    size_t size() const {
+        return by_count.size();
+    }
+
+    // Up to k book ids with the highest average among books with at least
+    // min_count ratings
+    std::vector<int> top_rated(size_t k, int min_count) const {
+        size_t tier = 0;
+        while (tier + 1 < tiers.size() && tiers[tier + 1] <= min_count) tier++;
+        std::vector<int> out;
+        for (auto it = by_average[tier].begin(); it != by_average[tier].end() && out.size() < k; ++it) {
+            if (it->count >= min_count) out.push_back(it->id);
+        }
+        return out;
+    }
+
+    // Up to k book ids with the most ratings
+    std::vector<int> most_rated(size_t k) const {
+        std::vector<int> out;
+        for (auto it = by_count.begin(); it != by_count.end() && out.size() < k; ++it) out.push_back(it->id);
+        return out;
+    }
+};
+
+#endif
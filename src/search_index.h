@@ -0,0 +1,194 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// ----------------------
+// SearchIndex: in-memory inverted index over book titles and authors.
+// Text is split on non-alphanumeric characters and ASCII case-folded; each
+// query word matches whole tokens or token prefixes. Postings are kept
+// sorted by book id so they can be merged or probed with binary search.
+// ----------------------
+class SearchIndex {
+public:
+    struct Hit {
+        int id;
+        double score;
+    };
+
+private:
+    enum Field : uint8_t { TITLE = 1, AUTHOR = 2 };
+
+    struct Posting {
+        int id;
+        uint8_t fields;   // which of TITLE/AUTHOR contain the token
+    };
+
+    // Ordered so that all tokens sharing a prefix form one contiguous range
+    std::map<std::string, std::vector<Posting>> postings;
+    size_t docs = 0;
+
+    static double field_score(uint8_t fields, bool exact) {
+        double s = 0.0;
+        if (fields & TITLE) s += exact ? 3.0 : 1.5;
+        if (fields & AUTHOR) s += exact ? 2.0 : 1.0;
+        return s;
+    }
+
+    // One query word expanded to the vocabulary entries it matches
+    struct Term {
+        std::vector<std::pair<const std::vector<Posting>*, bool>> lists;  // (postings, exact match)
+        size_t cost = 0;                                                   // total postings
+    };
+
+    Term expand(const std::string& word) const {
+        Term t;
+        for (auto it = postings.lower_bound(word); it != postings.end(); ++it) {
+            if (it->first.compare(0, word.size(), word) != 0) break;
+            t.lists.emplace_back(&it->second, it->first.size() == word.size());
+            t.cost += it->second.size();
+        }
+        return t;
+    }
+
+    // Best score of a term for one document (0 if the document lacks it)
+    static double probe(const Term& t, int id) {
+        double best = 0.0;
+        for (auto& l : t.lists) {
+            auto it = std::lower_bound(l.first->begin(), l.first->end(), id,
+                                       [](const Posting& p, int v) { return p.id < v; });
+            if (it != l.first->end() && it->id == id) best = std::max(best, field_score(it->fields, l.second));
+        }
+        return best;
+    }
+
+    void add_token(const std::string& tok, int id, uint8_t field) {
+        std::vector<Posting>& list = postings[tok];
+        if (!list.empty() && list.back().id == id) {
+            list.back().fields |= field;
+            return;
+        }
+        if (list.empty() || list.back().id < id) {
+            list.push_back({id, field});   // common case: ids arrive in increasing order
+            return;
+        }
+        auto it = std::lower_bound(list.begin(), list.end(), id,
+                                   [](const Posting& p, int v) { return p.id < v; });
+        if (it != list.end() && it->id == id) it->fields |= field;
+        else list.insert(it, {id, field});
+    }
+
+public:
+    static void tokenize(std::string_view text, std::vector<std::string>& out) {
+        std::string cur;
+        for (unsigned char c : text) {
+            if (std::isalnum(c) || c >= 0x80) {
+                cur += (char)std::tolower(c);
+            } else if (!cur.empty()) {
+                out.push_back(cur);
+                cur.clear();
+            }
+        }
+        if (!cur.empty()) out.push_back(cur);
+    }
+
+    void add(int id, std::string_view title, std::string_view author) {
+        std::vector<std::string> toks;
+        tokenize(title, toks);
+        for (auto& t : toks) add_token(t, id, TITLE);
+        toks.clear();
+        tokenize(author, toks);
+        for (auto& t : toks) add_token(t, id, AUTHOR);
+        docs++;
+    }
+
+    // Remove a book; title/author must be the values it was added with
+    void remove(int id, std::string_view title, std::string_view author) {
+        std::vector<std::string> toks;
+        tokenize(title, toks);
+        tokenize(author, toks);
+        for (auto& t : toks) {
+            auto p = postings.find(t);
+            if (p == postings.end()) continue;
+            auto& list = p->second;
+            auto it = std::lower_bound(list.begin(), list.end(), id,
+                                       [](const Posting& q, int v) { return q.id < v; });
+            if (it != list.end() && it->id == id) list.erase(it);
+            if (list.empty()) postings.erase(p);
+        }
+        if (docs > 0) docs--;
+    }
+
+    void clear() {
+        postings.clear();
+        docs = 0;
+    }
+
+    size_t size() const {
+        return docs;
+    }
+
+    size_t vocabulary() const {
+        return postings.size();
+    }
+
+    // Top-k books containing every query word (as a token or token prefix),
+    // best score first; ties go to the lower id.
+    std::vector<Hit> search(const std::string& query, size_t k) const {
+        std::vector<Hit> hits;
+        std::vector<std::string> words;
+        tokenize(query, words);
+        if (words.empty() || k == 0) return hits;
+
+        std::vector<Term> terms;
+        for (auto& w : words) {
+            terms.push_back(expand(w));
+            if (terms.back().cost == 0) return hits;   // a word nothing matches
+        }
+        // Seed candidates from the most selective word, then probe the rest
+        std::sort(terms.begin(), terms.end(), [](const Term& a, const Term& b) { return a.cost < b.cost; });
+
+        std::unordered_map<int, double> cand;
+        cand.reserve(terms[0].cost);
+        for (auto& l : terms[0].lists) {
+            for (auto& p : *l.first) {
+                double& s = cand[p.id];
+                s = std::max(s, field_score(p.fields, l.second));
+            }
+        }
+
+        for (size_t i = 1; i < terms.size() && !cand.empty(); i++) {
+            for (auto it = cand.begin(); it != cand.end();) {
+                double s = probe(terms[i], it->first);
+                if (s == 0.0) {
+                    it = cand.erase(it);
+                } else {
+                    it->second += s;
+                    ++it;
+                }
+            }
+        }
+
+        hits.reserve(cand.size());
+        for (auto& c : cand) hits.push_back({c.first, c.second});
+        auto better = [](const Hit& a, const Hit& b) {
+            return a.score != b.score ? a.score > b.score : a.id < b.id;
+        };
+        if (hits.size() > k) {
+            std::partial_sort(hits.begin(), hits.begin() + k, hits.end(), better);
+            hits.resize(k);
+        } else {
+            std::sort(hits.begin(), hits.end(), better);
+        }
+        return hits;
+    }
+};
+
+#endif
@@ -0,0 +1,415 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "sqlite3.h"
+
+// ----------------------
+// Snapshot: compact binary dump of whole tables, written by streaming
+// through one read transaction and restored with bulk inserts.
+//
+// File layout (integers little-endian):
+//   "LMSSNAP1", u32 table count, then per table
+//     str name, str CREATE TABLE sql, u32 column count, column names (str),
+//     row blocks: u32 rows (0 ends the table), u32 payload bytes,
+//                 u32 FNV-1a checksum of the payload, payload,
+//     u32 index count, CREATE INDEX sql (str) for each.
+//   str = u32 length + bytes. The payload holds rows * columns values,
+//   each a tag byte: 0 NULL | 1 zigzag varint | 2 8-byte double | 3 text
+//   (varint length + bytes) | 4 blob (same).
+// At most one block is held in memory on either side. Include
+// "sqlite_sequence" last to carry AUTOINCREMENT counters across.
+// ----------------------
+class Snapshot {
+public:
+    struct Stats {
+        size_t tables = 0;
+        size_t rows = 0;
+        uint64_t bytes = 0;
+    };
+
+private:
+    static constexpr char MAGIC[9] = "LMSSNAP1";
+    static const size_t BLOCK_ROWS = 4096;
+    static const size_t BLOCK_BYTES = 1u << 20;
+
+    enum Tag : uint8_t { T_NULL = 0, T_INT = 1, T_REAL = 2, T_TEXT = 3, T_BLOB = 4 };
+
+    static uint32_t checksum(const std::string& s) {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    // ---- encoding ----
+    static void put_u32(std::string& out, uint32_t v) {
+        for (int i = 0; i < 4; i++) out += (char)((v >> (8 * i)) & 0xFF);
+    }
+    static void put_varint(std::string& out, uint64_t v) {
+        while (v >= 0x80) {
+            out += (char)((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        out += (char)v;
+    }
+    static void put_str(std::string& out, const char* s, size_t n) {
+        put_u32(out, (uint32_t)n);
+        out.append(s, n);
+    }
+
+    // ---- decoding: a cursor over a byte range ----
+    struct Cursor {
+        const char* p;
+        const char* end;
+
+        bool u32(uint32_t& v) {
+            if (end - p < 4) return false;
+            v = 0;
+            for (int i = 0; i < 4; i++) v |= (uint32_t)(unsigned char)p[i] << (8 * i);
+            p += 4;
+            return true;
+        }
+        bool varint(uint64_t& v) {
+            v = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (p == end) return false;
+                unsigned char c = (unsigned char)*p++;
+                v |= (uint64_t)(c & 0x7F) << shift;
+                if (!(c & 0x80)) return true;
+            }
+            return false;
+        }
+        bool bytes(size_t n, const char*& out) {
+            if ((size_t)(end - p) < n) return false;
+            out = p;
+            p += n;
+            return true;
+        }
+    };
+
+    static bool read_exact(std::ifstream& in, std::string& buf, size_t n) {
+        buf.resize(n);
+        in.read(&buf[0], (std::streamsize)n);
+        return (size_t)in.gcount() == n;
+    }
+    static bool read_u32(std::ifstream& in, uint32_t& v) {
+        std::string b;
+        if (!read_exact(in, b, 4)) return false;
+        Cursor c{b.data(), b.data() + 4};
+        return c.u32(v);
+    }
+    static bool read_str(std::ifstream& in, std::string& s) {
+        uint32_t n;
+        return read_u32(in, n) && read_exact(in, s, n);
+    }
+
+    static bool exec(sqlite3* db, const std::string& sql, std::string& err) {
+        char* msg = nullptr;
+        if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &msg) == SQLITE_OK) return true;
+        err = msg ? msg : sqlite3_errmsg(db);
+        if (msg) sqlite3_free(msg);
+        return false;
+    }
+
+    static std::string quoted(const std::string& ident) {
+        std::string q = "\"";
+        for (char c : ident) q += c == '"' ? std::string("\"\"") : std::string(1, c);
+        return q + "\"";
+    }
+
+    static bool write_table(sqlite3* db, const std::string& table, std::ofstream& out, Stats& st, std::string& err) {
+        std::string head;
+        sqlite3_stmt* stmt = nullptr;
+
+        // Definition, so a restore needs nothing but the snapshot
+        std::string create;
+        if (sqlite3_prepare_v2(db, "SELECT sql FROM sqlite_master WHERE type = 'table' AND name = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+            err = sqlite3_errmsg(db);
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, table.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) create = (const char*)sqlite3_column_text(stmt, 0);
+        sqlite3_finalize(stmt);
+        if (create.empty()) {
+            err = "no such table: " + table;
+            return false;
+        }
+
+        std::string select = "SELECT * FROM " + quoted(table) + " ORDER BY rowid;";
+        if (sqlite3_prepare_v2(db, select.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            err = sqlite3_errmsg(db);
+            return false;
+        }
+        int ncols = sqlite3_column_count(stmt);
+        put_str(head, table.data(), table.size());
+        put_str(head, create.data(), create.size());
+        put_u32(head, (uint32_t)ncols);
+        for (int c = 0; c < ncols; c++) {
+            const char* name = sqlite3_column_name(stmt, c);
+            put_str(head, name, strlen(name));
+        }
+        out.write(head.data(), (std::streamsize)head.size());
+        st.bytes += head.size();
+
+        std::string block;
+        uint32_t rows = 0;
+        auto flush = [&]() {
+            std::string frame;
+            put_u32(frame, rows);
+            put_u32(frame, (uint32_t)block.size());
+            put_u32(frame, checksum(block));
+            out.write(frame.data(), (std::streamsize)frame.size());
+            out.write(block.data(), (std::streamsize)block.size());
+            st.bytes += frame.size() + block.size();
+            st.rows += rows;
+            block.clear();
+            rows = 0;
+        };
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            for (int c = 0; c < ncols; c++) {
+                switch (sqlite3_column_type(stmt, c)) {
+                    case SQLITE_INTEGER: {
+                        int64_t v = sqlite3_column_int64(stmt, c);
+                        block += (char)T_INT;
+                        put_varint(block, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+                        break;
+                    }
+                    case SQLITE_FLOAT: {
+                        double d = sqlite3_column_double(stmt, c);
+                        uint64_t bits;
+                        memcpy(&bits, &d, sizeof(bits));
+                        block += (char)T_REAL;
+                        for (int i = 0; i < 8; i++) block += (char)((bits >> (8 * i)) & 0xFF);
+                        break;
+                    }
+                    case SQLITE_TEXT:
+                    case SQLITE_BLOB: {
+                        bool text = sqlite3_column_type(stmt, c) == SQLITE_TEXT;
+                        const void* data = text ? (const void*)sqlite3_column_text(stmt, c) : sqlite3_column_blob(stmt, c);
+                        int n = sqlite3_column_bytes(stmt, c);
+                        block += (char)(text ? T_TEXT : T_BLOB);
+                        put_varint(block, (uint64_t)n);
+                        block.append((const char*)data, (size_t)n);
+                        break;
+                    }
+                    default:
+                        block += (char)T_NULL;
+                }
+            }
+            if (++rows >= BLOCK_ROWS || block.size() >= BLOCK_BYTES) flush();
+        }
+        if (rc != SQLITE_DONE) err = sqlite3_errmsg(db);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) return false;
+        if (rows > 0) flush();
+
+        std::string tail;
+        put_u32(tail, 0);   // end of rows
+        std::vector<std::string> indexes;
+        if (sqlite3_prepare_v2(db, "SELECT sql FROM sqlite_master WHERE type = 'index' AND tbl_name = ? AND sql IS NOT NULL;", -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, table.c_str(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(stmt) == SQLITE_ROW) indexes.push_back((const char*)sqlite3_column_text(stmt, 0));
+            sqlite3_finalize(stmt);
+        }
+        put_u32(tail, (uint32_t)indexes.size());
+        for (auto& sql : indexes) put_str(tail, sql.data(), sql.size());
+        out.write(tail.data(), (std::streamsize)tail.size());
+        st.bytes += tail.size();
+        st.tables++;
+        return true;
+    }
+
+    static bool bind_value(sqlite3_stmt* stmt, int col, Cursor& c) {
+        const char* p;
+        if (!c.bytes(1, p)) return false;
+        switch ((uint8_t)*p) {
+            case T_NULL:
+                return sqlite3_bind_null(stmt, col) == SQLITE_OK;
+            case T_INT: {
+                uint64_t z;
+                if (!c.varint(z)) return false;
+                return sqlite3_bind_int64(stmt, col, (sqlite3_int64)((z >> 1) ^ (~(z & 1) + 1))) == SQLITE_OK;
+            }
+            case T_REAL: {
+                const char* b;
+                if (!c.bytes(8, b)) return false;
+                uint64_t bits = 0;
+                for (int i = 0; i < 8; i++) bits |= (uint64_t)(unsigned char)b[i] << (8 * i);
+                double d;
+                memcpy(&d, &bits, sizeof(d));
+                return sqlite3_bind_double(stmt, col, d) == SQLITE_OK;
+            }
+            case T_TEXT:
+            case T_BLOB: {
+                bool text = (uint8_t)*p == T_TEXT;
+                uint64_t n;
+                const char* data;
+                if (!c.varint(n) || !c.bytes((size_t)n, data)) return false;
+                return (text ? sqlite3_bind_text(stmt, col, data, (int)n, SQLITE_STATIC)
+                             : sqlite3_bind_blob(stmt, col, data, (int)n, SQLITE_STATIC)) == SQLITE_OK;
+            }
+        }
+        return false;
+    }
+
+    static bool restore_tables(std::ifstream& in, sqlite3* db, Stats& st, std::string& err) {
+        std::string buf;
+        uint32_t ntables;
+        if (!read_exact(in, buf, 8) || buf != MAGIC || !read_u32(in, ntables)) {
+            err = "not a library snapshot";
+            return false;
+        }
+        for (uint32_t t = 0; t < ntables; t++) {
+            std::string name, create;
+            uint32_t ncols;
+            if (!read_str(in, name) || !read_str(in, create) || !read_u32(in, ncols) || ncols == 0) {
+                err = "truncated table header";
+                return false;
+            }
+            std::string insert = "INSERT INTO " + quoted(name) + " (";
+            for (uint32_t c = 0; c < ncols; c++) {
+                std::string col;
+                if (!read_str(in, col)) {
+                    err = "truncated table header";
+                    return false;
+                }
+                insert += (c ? ", " : "") + quoted(col);
+            }
+            insert += ") VALUES (";
+            for (uint32_t c = 0; c < ncols; c++) insert += c ? ", ?" : "?";
+            insert += ");";
+
+            // sqlite_sequence exists once an AUTOINCREMENT table does; its
+            // saved counters replace the ones the inserts above produced
+            bool ok = name == "sqlite_sequence" ? exec(db, "DELETE FROM sqlite_sequence;", err) : exec(db, create, err);
+            if (!ok) return false;
+            sqlite3_stmt* stmt = nullptr;
+            if (sqlite3_prepare_v2(db, insert.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+                err = sqlite3_errmsg(db);
+                return false;
+            }
+
+            while (ok) {
+                uint32_t rows, size, sum;
+                if (!read_u32(in, rows)) { ok = false; err = "truncated row block"; break; }
+                if (rows == 0) break;
+                if (!read_u32(in, size) || !read_u32(in, sum) || !read_exact(in, buf, size)) { ok = false; err = "truncated row block"; break; }
+                if (checksum(buf) != sum) { ok = false; err = "checksum mismatch in table " + name; break; }
+
+                Cursor cur{buf.data(), buf.data() + buf.size()};
+                for (uint32_t r = 0; ok && r < rows; r++) {
+                    for (uint32_t c = 0; ok && c < ncols; c++) ok = bind_value(stmt, (int)c + 1, cur);
+                    if (!ok) { err = "corrupt row in table " + name; break; }
+                    if (sqlite3_step(stmt) != SQLITE_DONE) { ok = false; err = sqlite3_errmsg(db); }
+                    sqlite3_reset(stmt);
+                }
+                st.rows += rows;
+            }
+            sqlite3_finalize(stmt);
+            if (!ok) return false;
+
+            // Secondary indexes are built once the rows are in
+            uint32_t nindexes;
+            if (!read_u32(in, nindexes)) {
+                err = "truncated index list";
+                return false;
+            }
+            for (uint32_t i = 0; i < nindexes; i++) {
+                std::string sql;
+                if (!read_str(in, sql)) {
+                    err = "truncated index list";
+                    return false;
+                }
+                if (!exec(db, sql, err)) return false;
+            }
+            st.tables++;
+        }
+        return true;
+    }
+
+public:
+    // Dump `tables` from db to path. Everything is read inside one read
+    // transaction, so the snapshot is consistent even if other connections
+    // write meanwhile. The file appears under its final name only when complete.
+    static bool write(sqlite3* db, const std::vector<std::string>& tables, const std::string& path, Stats& st, std::string& err) {
+        std::string tmp = path + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            err = "cannot create " + tmp;
+            return false;
+        }
+        std::string head(MAGIC, 8);
+        put_u32(head, (uint32_t)tables.size());
+        out.write(head.data(), (std::streamsize)head.size());
+        st.bytes += head.size();
+
+        bool ok = exec(db, "BEGIN;", err);
+        for (size_t i = 0; ok && i < tables.size(); i++) ok = write_table(db, tables[i], out, st, err);
+        std::string ignored;
+        exec(db, ok ? "COMMIT;" : "ROLLBACK;", ignored);
+
+        out.close();
+        if (ok && !out) {
+            err = "write error on " + tmp;
+            ok = false;
+        }
+        if (ok) {
+            std::remove(path.c_str());
+            if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+                err = "cannot rename " + tmp + " to " + path;
+                ok = false;
+            }
+        }
+        if (!ok) std::remove(tmp.c_str());
+        return ok;
+    }
+
+    // Rebuild db_file from a snapshot. The database is built in a side file
+    // with journaling off (it is discarded on any failure) and only then
+    // moved over db_file, which must not be open.
+    static bool restore(const std::string& path, const std::string& db_file, Stats& st, std::string& err) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            err = "cannot open " + path;
+            return false;
+        }
+        std::string tmp = db_file + ".restore";
+        std::remove(tmp.c_str());
+
+        sqlite3* db = nullptr;
+        if (sqlite3_open(tmp.c_str(), &db) != SQLITE_OK) {
+            err = db ? sqlite3_errmsg(db) : "cannot open " + tmp;
+            sqlite3_close(db);
+            return false;
+        }
+        bool ok = exec(db, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF; PRAGMA locking_mode = EXCLUSIVE; BEGIN;", err)
+               && restore_tables(in, db, st, err)
+               && exec(db, "COMMIT;", err);
+        sqlite3_close(db);
+
+        if (ok) {
+            std::remove(db_file.c_str());
+            std::remove((db_file + "-journal").c_str());
+            std::remove((db_file + "-wal").c_str());
+            std::remove((db_file + "-shm").c_str());
+            if (std::rename(tmp.c_str(), db_file.c_str()) != 0) {
+                err = "cannot rename " + tmp + " to " + db_file;
+                ok = false;
+            }
+        }
+        if (!ok) std::remove(tmp.c_str());
+        return ok;
+    }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef STATEMENT_CACHE_H
+#define STATEMENT_CACHE_H
+
+#include <string>
+#include <unordered_map>
+#include "sqlite3.h"
+
+// ----------------------
+// StatementCache: prepares each SQL text once per connection and hands the
+// compiled statement back on every later use.
+// ----------------------
+class StatementCache {
+private:
+    sqlite3* db;
+    std::unordered_map<std::string, sqlite3_stmt*> stmts;
+
+public:
+    explicit StatementCache(sqlite3* conn = nullptr) : db(conn) {
+
+    }
+    ~StatementCache() {
+        clear();
+    }
+
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    void attach(sqlite3* conn) {
+        clear();
+        db = conn;
+    }
+
+    // Returns a ready-to-bind statement, or nullptr if the SQL fails to compile.
+    // The statement stays owned by the cache; wrap it in a StmtGuard.
+    sqlite3_stmt* get(const char* sql) {
+        auto it = stmts.find(sql);
+        if (it != stmts.end()) return it->second;
+
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK) {
+            return nullptr;
+        }
+        stmts.emplace(sql, stmt);
+        return stmt;
+    }
+
+    size_t size() const {
+        return stmts.size();
+    }
+
+    // Finalize everything; must run before the connection is closed
+    void clear() {
+        for (auto& p : stmts) sqlite3_finalize(p.second);
+        stmts.clear();
+    }
+};
+
+// ----------------------
+// StmtGuard: resets a cached statement and clears its bindings when the
+// scope ends, so it never holds a read lock or stale parameters.
+// ----------------------
+class StmtGuard {
+private:
+    sqlite3_stmt* stmt;
+
+public:
+    explicit StmtGuard(sqlite3_stmt* s) : stmt(s) {
+
+    }
+    ~StmtGuard() {
+        if (stmt) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+    }
+
+    StmtGuard(const StmtGuard&) = delete;
+    StmtGuard& operator=(const StmtGuard&) = delete;
+
+    sqlite3_stmt* get() const {
+        return stmt;
+    }
+    explicit operator bool() const {
+        return stmt != nullptr;
+    }
+
+    // Step a statement that returns no rows; resets so it can be stepped again
+    bool run() {
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        return rc == SQLITE_DONE;
+    }
+};
+
+#endif
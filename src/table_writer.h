@@ -0,0 +1,179 @@
+#ifndef TABLE_WRITER_H
+#define TABLE_WRITER_H
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// ----------------------
+// DateCache: local dates as YYYY-MM-DD, formatted once per calendar day.
+// Each cached day covers [local midnight, next local midnight), so a lookup
+// is a map search and localtime/strftime only run for a day not seen yet
+// (day lengths come from mktime, so DST changes are handled).
+// ----------------------
+class DateCache {
+private:
+    struct Day {
+        time_t end;
+        char text[11];
+    };
+    std::map<time_t, Day> days;   // key: local midnight
+    const Day* last = nullptr;
+    time_t last_start = 0;
+
+public:
+    // "-" for 0, like Library::epochToStr; valid until the next call
+    std::string_view format(time_t t) {
+        if (t == 0) return "-";
+        if (last && t >= last_start && t < last->end) return std::string_view(last->text, 10);
+        auto it = days.upper_bound(t);
+        if (it != days.begin() && t < std::prev(it)->second.end) {
+            --it;
+        } else {
+            struct tm tmv;
+#ifdef _WIN32
+            localtime_s(&tmv, &t);
+#else
+            localtime_r(&t, &tmv);
+#endif
+            Day d;
+            strftime(d.text, sizeof(d.text), "%Y-%m-%d", &tmv);
+            struct tm mid = tmv;
+            mid.tm_hour = mid.tm_min = mid.tm_sec = 0;
+            mid.tm_isdst = -1;
+            time_t start = mktime(&mid);
+            mid.tm_mday += 1;
+            mid.tm_isdst = -1;
+            d.end = mktime(&mid);
+            if (start == (time_t)-1 || d.end == (time_t)-1 || t < start || t >= d.end) {
+                start = t;   // outside what mktime can round-trip: cache just this second
+                d.end = t + 1;
+            }
+            it = days.insert_or_assign(start, d).first;
+        }
+        last = &it->second;
+        last_start = it->first;
+        return std::string_view(last->text, 10);
+    }
+};
+
+// ----------------------
+// TableWriter: fixed-width rows appended into one reusable buffer and
+// handed to the stream in large writes, instead of a formatted stream
+// insertion per cell. Cells are left-aligned and padded to their width;
+// like setw, a longer value is written whole.
+// With page_rows set, row() stops after each page (flushing it) and asks
+// `more` whether to continue.
+// ----------------------
+class TableWriter {
+private:
+    static constexpr size_t FLUSH_BYTES = 256 * 1024;
+
+    std::ostream& out;
+    std::string buf;
+    DateCache dates;
+    size_t page_rows;
+    std::function<bool(size_t)> more;   // called with the rows shown so far
+    size_t rows = 0;
+    bool stopped = false;
+
+    void pad(size_t len, size_t width) {
+        if (len < width) buf.append(width - len, ' ');
+    }
+
+public:
+    explicit TableWriter(std::ostream& o, size_t page = 0, std::function<bool(size_t)> ask = nullptr)
+        : out(o), page_rows(page), more(std::move(ask)) {
+        buf.reserve(FLUSH_BYTES + 4096);
+    }
+
+    ~TableWriter() {
+        flush();
+    }
+
+    TableWriter(const TableWriter&) = delete;
+    TableWriter& operator=(const TableWriter&) = delete;
+
+    // Call before each data row; false once the reader has stopped paging
+    bool row() {
+        if (stopped) return false;
+        if (page_rows > 0 && rows > 0 && rows % page_rows == 0) {
+            flush();
+            if (!more || !more(rows)) {
+                stopped = true;
+                return false;
+            }
+        }
+        rows++;
+        return true;
+    }
+
+    TableWriter& text(std::string_view s, size_t width = 0) {
+        buf.append(s.data(), s.size());
+        pad(s.size(), width);
+        return *this;
+    }
+
+    TableWriter& num(int64_t v, size_t width = 0) {
+        char tmp[24];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        return text(std::string_view(tmp, (size_t)(r.ptr - tmp)), width);
+    }
+
+    // One decimal place, rounded exactly as printf("%.1f") would
+    TableWriter& fixed1(double v, size_t width = 0) {
+        double tenths = v * 10.0;
+        double whole = std::floor(tenths);
+        if (!std::isfinite(v) || std::fabs(tenths - whole - 0.5) < 1e-6 || std::fabs(tenths) > 1e15) {
+            // Near a tie the decimal expansion decides; let printf do it
+            char tmp[64];
+            int n = snprintf(tmp, sizeof(tmp), "%.1f", v);
+            return text(std::string_view(tmp, n > 0 ? (size_t)n : 0), width);
+        }
+        int64_t t = (int64_t)std::llround(tenths);
+        char tmp[32];
+        char* p = tmp;
+        if (t < 0) {
+            *p++ = '-';
+            t = -t;
+        }
+        auto r = std::to_chars(p, tmp + sizeof(tmp) - 2, t / 10);
+        p = r.ptr;
+        *p++ = '.';
+        *p++ = (char)('0' + t % 10);
+        return text(std::string_view(tmp, (size_t)(p - tmp)), width);
+    }
+
+    // Local date, "-" for 0
+    TableWriter& date(time_t t, size_t width = 0) {
+        return text(dates.format(t), width);
+    }
+
+    void end_row() {
+        buf.push_back('\n');
+        if (buf.size() >= FLUSH_BYTES) flush();
+    }
+
+    void flush() {
+        if (!buf.empty()) out.write(buf.data(), (std::streamsize)buf.size());
+        buf.clear();
+        out.flush();
+    }
+
+    size_t rows_written() const {
+        return rows;
+    }
+
+    bool was_stopped() const {
+        return stopped;
+    }
+};
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef WRITE_BEHIND_H
+#define WRITE_BEHIND_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ----------------------
+// SpscRing: bounded ring buffer for one producer thread and one consumer
+// thread. push and pop are a load and a store on two atomic indexes, with
+// no locks; the capacity is rounded up to a power of two.
+// ----------------------
+template <class T>
+class SpscRing {
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};   // next slot to pop (consumer)
+    alignas(64) std::atomic<size_t> tail{0};   // next slot to fill (producer)
+
+    static size_t round_up(size_t n) {
+        size_t c = 2;
+        while (c < n) c <<= 1;
+        return c;
+    }
+
+public:
+    explicit SpscRing(size_t capacity) : slots(round_up(capacity)), mask(slots.size() - 1) {
+
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer only; false when full
+    bool try_push(const T& v) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+        slots[t & mask] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only; false when empty
+    bool try_pop(T& out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        out = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+};
+
+// ----------------------
+// WriteBehind: jobs queued by the caller are written by a background
+// thread in batched transactions. A batch is started once `batch` jobs are
+// waiting, `flush_ms` after the writer last went idle, or on flush(). The
+// queue holds at most `max_lag` jobs; push() blocks while it is full, so
+// unwritten work never exceeds that many jobs.
+// apply(jobs) writes one batch in one transaction and returns false if it
+// rolled back; the same batch is then retried, because its changes are
+// already visible in memory and must reach the database.
+// push() must be called by one thread at a time (callers serialize it);
+// flush() and pending() may be called from any thread.
+// ----------------------
+template <class Job>
+class WriteBehind {
+public:
+    struct Options {
+        size_t max_lag = 4096;   // queued jobs before push() blocks
+        size_t batch = 512;      // jobs per transaction at most
+        int flush_ms = 100;      // longest a job waits before its batch starts
+    };
+
+    struct Stats {
+        uint64_t batches = 0;
+        uint64_t jobs = 0;
+        uint64_t retries = 0;   // batches that rolled back and were tried again
+    };
+
+private:
+    static constexpr int RETRY_MS = 100;
+    static constexpr int STOP_ATTEMPTS = 50;   // retries allowed while stopping
+
+    std::unique_ptr<SpscRing<Job>> ring;
+    Options opt;
+    std::function<bool(std::vector<Job>&)> apply;
+    std::function<void(const std::string&)> on_error;
+    std::thread writer;
+
+    std::atomic<uint64_t> pushed{0};      // jobs queued so far (producer)
+    std::atomic<uint64_t> written{0};     // jobs committed so far (writer)
+    std::atomic<uint64_t> batches{0}, retries{0};
+
+    std::mutex m;
+    std::condition_variable wake;   // writer: work, a flush or stop
+    std::condition_variable done;   // producers and flushers: a batch finished
+    bool flush_wanted = false;
+    bool stopping = false;
+    bool running = false;
+
+    void run() {
+        std::vector<Job> jobs;
+        jobs.reserve(opt.batch);
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                wake.wait_for(lock, std::chrono::milliseconds(opt.flush_ms),
+                              [&] { return stopping || flush_wanted || ring->size() >= opt.batch; });
+                if (stopping && ring->size() == 0) break;
+            }
+            while (true) {
+                jobs.clear();
+                Job j;
+                while (jobs.size() < opt.batch && ring->try_pop(j)) jobs.push_back(std::move(j));
+                if (jobs.empty()) break;
+                done.notify_all();   // room in the queue again
+                if (!commit(jobs)) return;
+            }
+            std::lock_guard<std::mutex> lock(m);
+            if (written.load() >= pushed.load()) flush_wanted = false;
+            done.notify_all();
+        }
+    }
+
+    bool commit(std::vector<Job>& jobs) {
+        for (int attempt = 1; !apply(jobs); attempt++) {
+            retries.fetch_add(1, std::memory_order_relaxed);
+            if (attempt == 1 && on_error) on_error("Write-behind batch of " + std::to_string(jobs.size()) + " failed; retrying.");
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                stop = stopping;
+            }
+            if (stop && attempt >= STOP_ATTEMPTS) {
+                if (on_error) on_error("Write-behind stopped with " + std::to_string(jobs.size() + ring->size()) + " unwritten operations.");
+                std::lock_guard<std::mutex> lock(m);
+                written.store(pushed.load());   // release any waiters
+                done.notify_all();
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(RETRY_MS));
+        }
+        batches.fetch_add(1, std::memory_order_relaxed);
+        written.fetch_add(jobs.size());
+        return true;
+    }
+
+public:
+    WriteBehind() = default;
+    ~WriteBehind() {
+        stop();
+    }
+
+    WriteBehind(const WriteBehind&) = delete;
+    WriteBehind& operator=(const WriteBehind&) = delete;
+
+    void start(const Options& o, std::function<bool(std::vector<Job>&)> apply_fn,
+               std::function<void(const std::string&)> error_fn = nullptr) {
+        stop();
+        opt = o;
+        if (opt.batch == 0) opt.batch = 1;
+        ring = std::make_unique<SpscRing<Job>>(opt.max_lag > 0 ? opt.max_lag : 1);
+        apply = std::move(apply_fn);
+        on_error = std::move(error_fn);
+        stopping = false;
+        flush_wanted = false;
+        running = true;
+        writer = std::thread([this] { run(); });
+    }
+
+    bool active() const {
+        return running;
+    }
+
+    void push(const Job& j) {
+        if (!ring->try_push(j)) {
+            // Full: wake the writer and wait for it to make room
+            std::unique_lock<std::mutex> lock(m);
+            flush_wanted = true;
+            wake.notify_one();
+            done.wait(lock, [&] { return ring->try_push(j); });
+        }
+        uint64_t n = pushed.fetch_add(1) + 1;
+        if (n - written.load(std::memory_order_relaxed) == opt.batch) {
+            std::lock_guard<std::mutex> lock(m);
+            wake.notify_one();
+        }
+    }
+
+    // Wait until every job pushed before the call is committed
+    void flush() {
+        if (!running) return;
+        uint64_t target = pushed.load();
+        if (written.load() >= target) return;
+        std::unique_lock<std::mutex> lock(m);
+        flush_wanted = true;
+        wake.notify_one();
+        done.wait(lock, [&] { return written.load() >= target; });
+    }
+
+    // Write everything still queued, then end the writer thread
+    void stop() {
+        if (!running) return;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+        running = false;
+    }
+
+    // Jobs queued but not yet committed
+    size_t pending() const {
+        return (size_t)(pushed.load() - written.load());
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.batches = batches.load(std::memory_order_relaxed);
+        s.jobs = written.load(std::memory_order_relaxed);
+        s.retries = retries.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+#endif